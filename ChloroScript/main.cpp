@@ -1,10 +1,14 @@
 #include <fmt/format.h>
 #include "src/lexer.h"
 #include "src/parser.h"
+#include "src/self_test.h"
+#include "src/utils/source_manager.h"
 
-int main()  // NOLINT
+int main(const int argc, const char** argv)
 {
-    auto tokens = cls::lex::Lexer(R"script(
+    using namespace std::literals;
+    if (argc == 2 && argv[1] == "--self-test"sv) return cls::lex::run_self_test() ? 0 : 1;
+    std::string_view script = R"script(
 
 global_var: int = 0;
 def func(arg: int): int
@@ -12,10 +16,14 @@ def func(arg: int): int
     local_var: int = 1;
 }
 
-)script").lex();
+)script";
     try
     {
-        auto ast = cls::parse::Parser(std::move(tokens)).parse();
+        cls::utils::SourceManager sources;
+        if (argc == 2) script = sources.text(sources.open(argv[1]));
+        cls::lex::NameTable names;
+        cls::lex::Lexer lexer(script, names);
+        auto ast = cls::parse::Parser(lexer).parse();
         return 0;
     }
     catch (const std::exception& e)
@@ -0,0 +1,112 @@
+#include "incremental_lexer.h"
+#include <algorithm>
+#include "lex_table.h"
+
+namespace cls::lex
+{
+    TokenGapBuffer::TokenGapBuffer(std::vector<Token> tokens, const size_t script_size) :
+        tokens_(std::move(tokens)), gap_begin_(tokens_.size()), gap_end_(tokens_.size()), script_size_(script_size) {}
+
+    void TokenGapBuffer::move_gap(const size_t index)
+    {
+        // Tokens passing the gap switch between offsets from the start and from the end
+        while (gap_begin_ > index)
+        {
+            Token& token = tokens_[--gap_end_] = tokens_[--gap_begin_];
+            token.offset = script_size_ - token.offset;
+        }
+        while (gap_begin_ < index)
+        {
+            Token& token = tokens_[gap_begin_++] = tokens_[gap_end_++];
+            token.offset = script_size_ - token.offset;
+        }
+    }
+
+    void TokenGapBuffer::reserve_gap(const size_t count)
+    {
+        if (gap_end_ - gap_begin_ >= count) return;
+        const size_t tail_size = tokens_.size() - gap_end_;
+        tokens_.resize(std::max(tokens_.size() * 2, size() + count));
+        std::move_backward(tokens_.begin() + gap_end_, tokens_.begin() + gap_end_ + tail_size, tokens_.end());
+        gap_end_ = tokens_.size() - tail_size;
+    }
+
+    size_t TokenGapBuffer::offset(const size_t index) const
+    {
+        if (index < gap_begin_) return tokens_[index].offset;
+        return script_size_ - tokens_[index + gap_end_ - gap_begin_].offset;
+    }
+
+    Token TokenGapBuffer::operator[](const size_t index) const
+    {
+        Token token = tokens_[index < gap_begin_ ? index : index + gap_end_ - gap_begin_];
+        token.offset = offset(index);
+        return token;
+    }
+
+    std::vector<Token> TokenGapBuffer::to_vector() const
+    {
+        std::vector<Token> result;
+        result.reserve(size());
+        for (size_t i = 0; i < size(); i++) result.push_back((*this)[i]);
+        return result;
+    }
+
+    void TokenGapBuffer::replace(const size_t first, const size_t last,
+        const std::vector<Token>& tokens, const size_t new_script_size)
+    {
+        move_gap(first);
+        gap_end_ += last - first; // The replaced tokens are right after the gap
+        reserve_gap(tokens.size());
+        std::copy(tokens.begin(), tokens.end(), tokens_.begin() + gap_begin_);
+        gap_begin_ += tokens.size();
+        // The tokens after the gap start after the edit, their offsets from the end stay the same
+        script_size_ = new_script_size;
+    }
+
+    void relex(TokenGapBuffer& tokens, const std::string_view script, const TextEdit& edit, NameTable& names)
+    {
+        const auto find = [&tokens](size_t low, const size_t offset) // First token starting at or after the offset
+        {
+            size_t high = tokens.size();
+            while (low < high)
+            {
+                const size_t middle = low + (high - low) / 2;
+                if (tokens.offset(middle) < offset) low = middle + 1;
+                else high = middle;
+            }
+            return low;
+        };
+        // A token ends before the next one starts and the lexer reads at most max_lookahead characters
+        // past its end, so the token before the first one starting after edit.offset - max_lookahead
+        // is the first one that may have read the edited text
+        const size_t reach = std::min(dfa::max_lookahead, edit.offset + 1);
+        size_t first = find(0, edit.offset + 1 - reach);
+        size_t restart = 0; // Nothing but whitespace and comments before
+        if (first != 0) restart = tokens.offset(--first);
+
+        const size_t old_edit_end = edit.offset + edit.removed_length;
+        const size_t new_edit_end = edit.offset + edit.inserted_text.size();
+        size_t old_token = find(first, old_edit_end);
+        std::vector<Token> relexed;
+        Lexer lexer(script, restart, names);
+        while (true)
+        {
+            Token token = lexer.next();
+            if (token.offset >= new_edit_end) // Both lexers restart from the same suffix
+            {
+                const size_t old_offset = token.offset - new_edit_end + old_edit_end;
+                old_token = find(old_token, old_offset);
+                if (old_token != tokens.size() && tokens.offset(old_token) == old_offset) break;
+            }
+            const bool is_end = std::holds_alternative<std::monostate>(token.content);
+            relexed.push_back(token);
+            if (is_end)
+            {
+                old_token = tokens.size();
+                break;
+            }
+        }
+        tokens.replace(first, old_token, relexed, script.size());
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "lexer.h"
+
+namespace cls::lex
+{
+    struct TextEdit final
+    {
+        size_t offset = 0;
+        size_t removed_length = 0;
+        std::string_view inserted_text;
+    };
+
+    // Tokens of a script under editing, kept in a gap buffer whose gap stays at the last edit.
+    // Tokens before the gap store their byte offsets from the start of the script and the ones
+    // after it from the end, so an edit at the gap touches neither. Moving the gap costs one step
+    // per token it passes, which is little as long as the edits are close to each other.
+    class TokenGapBuffer final
+    {
+    private:
+        std::vector<Token> tokens_; // The gap included
+        size_t gap_begin_ = 0;
+        size_t gap_end_ = 0;
+        size_t script_size_ = 0;
+        void move_gap(size_t index);
+        void reserve_gap(size_t count);
+    public:
+        TokenGapBuffer(std::vector<Token> tokens, size_t script_size);
+        size_t size() const { return tokens_.size() - (gap_end_ - gap_begin_); }
+        size_t offset(size_t index) const;
+        Token operator[](size_t index) const;
+        std::vector<Token> to_vector() const;
+        // Replaces the tokens in [first, last) after an edit between those,
+        // the tokens from last on must start after the edit
+        void replace(size_t first, size_t last, const std::vector<Token>& tokens, size_t new_script_size);
+    };
+
+    // Updates the tokens of a script after an edit, the script is the text after the edit.
+    // Lexing restarts at the first token that may have read the edited text and stops as soon as
+    // a new token starts where an old one did, the remaining old tokens are kept as they are.
+    // The names interned before must stay valid, use a NameTable which copies the names
+    // if the previous text does not outlive the table.
+    void relex(TokenGapBuffer& tokens, std::string_view script, const TextEdit& edit, NameTable& names);
+}
@@ -1,17 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <optional>
 #include <string_view>
 #include <variant>
+#include "name_table.h"
 
 namespace cls::lex
 {
-    struct Position final
-    {
-        size_t line = 1;
-        size_t column = 1;
-    };
-
     enum class Symbol : uint8_t
     {
         equal,
@@ -36,38 +32,45 @@ namespace cls::lex
         max_value
     };
 
-    struct Identifier final { std::string name; };
+    struct Identifier final { NameId name = 0; };
     struct Integer final { int32_t value = 0; };
 
+    using TokenContent = std::variant<
+        Symbol, Keyword, Identifier, Integer,
+        LexError,
+        std::monostate // End of stream token
+    >;
+
     struct Token final
     {
-        std::variant<
-            Symbol, Keyword, Identifier, Integer,
-            LexError,
-            std::monostate // End of stream token
-        > content;
-        Position position;
+        TokenContent content;
+        size_t offset = 0; // Byte offset of the token in the script, see LineIndex for line and column
     };
 
     class Lexer final
     {
     private:
         std::string_view script_;
-        std::vector<Token> result_;
+        NameTable& names_;
         size_t index_ = 0;
-        Position position_;
         char current() const { return script_[index_]; }
         bool is_end() const { return script_.length() <= index_; }
+        const char* cursor() const { return script_.data() + index_; }
+        const char* end() const { return script_.data() + script_.size(); }
+        void move_to(const char* ptr) { index_ = size_t(ptr - script_.data()); }
         void skip_whitespace();
         void skip_single_line_comment();
-        void skip_multi_line_comment();
+        std::optional<Token> skip_multi_line_comment();
         void skip_enter();
-        void match_identifier_or_keyword();
-        void match_symbol();
-        void match_integer_literal();
-        void consume_error();
+        std::optional<Token> match_token();
+        Token consume_error();
     public:
-        explicit Lexer(const std::string_view script) :script_(script) {}
+        Lexer(const std::string_view script, NameTable& names) :script_(script), names_(names) {}
+        // Starts lexing at the given offset, the offsets of the tokens are still relative to the whole script
+        Lexer(const std::string_view script, const size_t offset, NameTable& names) :
+            script_(script), names_(names), index_(offset) {}
+        std::string_view script() const { return script_; }
+        Token next();
         std::vector<Token> lex();
     };
 }
@@ -0,0 +1,30 @@
+#include "line_index.h"
+#include <algorithm>
+#include "utils/char_ranges.h"
+
+namespace cls::lex
+{
+    namespace
+    {
+        constexpr utils::CharRanges new_line = utils::StaticCharSet("\r\n");
+    }
+
+    LineIndex::LineIndex(const std::string_view script) :script_(script)
+    {
+        const char* const end = script.data() + script.size();
+        const char* ptr = script.data();
+        while ((ptr = new_line.find(ptr, end)) != end)
+        {
+            if (*ptr++ == '\r' && ptr != end && *ptr == '\n') ptr++; // CRLF is a single line break
+            line_starts_.push_back(size_t(ptr - script.data()));
+        }
+    }
+
+    Position LineIndex::position(const size_t offset) const
+    {
+        const auto iter = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - 1;
+        const std::string_view line = script_.substr(*iter, offset - *iter);
+        const auto tab_count = size_t(std::count(line.begin(), line.end(), '\t'));
+        return { size_t(iter - line_starts_.begin()) + 1, line.size() + tab_count * 3 + 1 };
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace cls::lex
+{
+    struct Position final
+    {
+        size_t line = 1;
+        size_t column = 1;
+    };
+
+    // Offsets of the line starts in a script, built once so that the positions of tokens
+    // only need to be resolved from their byte offsets when a diagnostic is reported
+    class LineIndex final
+    {
+    private:
+        std::vector<size_t> line_starts_{ 0 };
+        std::string_view script_;
+    public:
+        explicit LineIndex(std::string_view script);
+        Position position(size_t offset) const; // Tabs take 4 columns
+        size_t line_count() const { return line_starts_.size(); }
+    };
+}
@@ -0,0 +1,16 @@
+#include "name_table.h"
+
+namespace cls::lex
+{
+    NameId NameTable::intern(std::string_view name)
+    {
+        if (copy_names_)
+        {
+            if (const auto iter = ids_.find(name); iter != ids_.end()) return iter->second;
+            name = copies_.emplace_back(name);
+        }
+        const auto [iter, inserted] = ids_.try_emplace(name, NameId(names_.size()));
+        if (inserted) names_.emplace_back(name);
+        return iter->second;
+    }
+}
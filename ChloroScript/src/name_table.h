@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+namespace cls::lex
+{
+    using NameId = uint32_t;
+
+    // Interns identifier names, equal names share one id so later stages can compare them as integers.
+    // Names are views into the source text, which must outlive the table, unless the table is asked
+    // to keep copies of the names, e.g. when the text is edited and relexed incrementally.
+    class NameTable final
+    {
+    private:
+        std::vector<std::string_view> names_;
+        std::unordered_map<std::string_view, NameId> ids_;
+        std::deque<std::string> copies_; // A deque never moves its elements
+        bool copy_names_ = false;
+    public:
+        NameTable() = default;
+        explicit NameTable(const bool copy_names) :copy_names_(copy_names) {}
+        NameTable(const NameTable&) = delete;
+        NameTable& operator=(const NameTable&) = delete;
+        NameTable(NameTable&&) = default;
+        NameTable& operator=(NameTable&&) = default;
+        NameId intern(std::string_view name);
+        std::string_view name(const NameId id) const { return names_[id]; }
+        size_t size() const { return names_.size(); }
+    };
+}
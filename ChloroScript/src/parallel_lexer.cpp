@@ -0,0 +1,122 @@
+#include "parallel_lexer.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace cls::lex
+{
+    namespace
+    {
+        struct Chunk final
+        {
+            size_t begin = 0;
+            size_t end = 0;
+            NameTable names; // Ids local to the chunk, remapped when the chunks are concatenated
+            std::vector<Token> tokens; // Without the end of stream token
+        };
+
+        std::vector<size_t> split(const std::string_view script, const size_t chunk_size)
+        {
+            std::vector<size_t> bounds{ 0 };
+            while (script.size() - bounds.back() > chunk_size)
+            {
+                const size_t line_break = script.find('\n', bounds.back() + chunk_size);
+                if (line_break == std::string_view::npos) break;
+                bounds.push_back(line_break + 1);
+            }
+            if (bounds.size() == 1 || bounds.back() != script.size()) bounds.push_back(script.size());
+            return bounds;
+        }
+
+        void lex_chunk(const std::string_view script, Chunk& chunk)
+        {
+            Lexer lexer(script.substr(0, chunk.end), chunk.begin, chunk.names);
+            for (Token token = lexer.next(); !std::holds_alternative<std::monostate>(token.content); token = lexer.next())
+                chunk.tokens.push_back(token);
+        }
+
+        bool ends_in_open_comment(const Chunk& chunk)
+        {
+            if (chunk.tokens.empty()) return false;
+            const auto* error = std::get_if<LexError>(&chunk.tokens.back().content);
+            return error && *error == LexError::open_multiline_comment;
+        }
+
+        void append(std::vector<Token>& result, Chunk& chunk, NameTable& names)
+        {
+            // Intern in the order of first occurrence, so that the ids match those of the serial lexer
+            constexpr NameId unmapped = UINT32_MAX;
+            std::vector<NameId> ids(chunk.names.size(), unmapped);
+            for (Token& token : chunk.tokens)
+            {
+                if (auto* identifier = std::get_if<Identifier>(&token.content))
+                {
+                    NameId& id = ids[identifier->name];
+                    if (id == unmapped) id = names.intern(chunk.names.name(identifier->name));
+                    identifier->name = id;
+                }
+                result.push_back(token);
+            }
+            chunk.tokens = std::vector<Token>(); // Release the memory early
+        }
+    }
+
+    std::vector<Token> lex_parallel(const std::string_view script, NameTable& names,
+        const size_t chunk_size, size_t thread_count)
+    {
+        const std::vector<size_t> bounds = split(script, std::max(chunk_size, size_t(1)));
+        std::vector<Chunk> chunks(bounds.size() - 1);
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            chunks[i].begin = bounds[i];
+            chunks[i].end = bounds[i + 1];
+        }
+
+        if (thread_count == 0) thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        thread_count = std::min(thread_count, chunks.size());
+        std::atomic<size_t> next_chunk{ 0 };
+        const auto worker = [&]
+        {
+            for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++)
+                lex_chunk(script, chunks[i]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; i++) threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads) thread.join();
+
+        // A block comment left open at the end of a chunk continues into the following chunks,
+        // the tokens lexed there are dropped and lexing restarts after the closing "*/"
+        std::vector<Token> result;
+        size_t token_count = 1;
+        for (const Chunk& chunk : chunks) token_count += chunk.tokens.size();
+        result.reserve(token_count);
+        Chunk relexed;
+        Chunk* current = &chunks[0];
+        for (size_t i = 0;;)
+        {
+            if (!ends_in_open_comment(*current))
+            {
+                append(result, *current, names);
+                if (++i == chunks.size()) break;
+                current = &chunks[i];
+                continue;
+            }
+            const size_t comment_end = script.find("*/", current->tokens.back().offset + 2);
+            if (comment_end == std::string_view::npos) // Really open till the end of the script
+            {
+                append(result, *current, names);
+                break;
+            }
+            current->tokens.pop_back();
+            append(result, *current, names);
+            const size_t resume = comment_end + 2;
+            i = size_t(std::upper_bound(bounds.begin(), bounds.end(), resume - 1) - bounds.begin()) - 1;
+            relexed = Chunk{ resume, chunks[i].end, NameTable(), {} };
+            lex_chunk(script, relexed);
+            current = &relexed;
+        }
+        result.push_back({ std::monostate{}, script.size() });
+        return result;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "lexer.h"
+
+namespace cls::lex
+{
+    constexpr size_t default_chunk_size = size_t(1) << 20;
+
+    // Lexes the script in chunks on multiple threads, the result is the same as Lexer::lex().
+    // Chunks are cut after line breaks, so that only block comments may cross a boundary,
+    // those are reconciled when the tokens of the chunks are concatenated.
+    // A thread count of 0 uses all hardware threads.
+    std::vector<Token> lex_parallel(std::string_view script, NameTable& names,
+        size_t chunk_size = default_chunk_size, size_t thread_count = 0);
+}
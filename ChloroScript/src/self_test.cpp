@@ -0,0 +1,127 @@
+#include "self_test.h"
+#include <fmt/format.h>
+#include <random>
+#include <string>
+#include <type_traits>
+#include "incremental_lexer.h"
+#include "parallel_lexer.h"
+#include "utils/overload.h"
+
+namespace cls::lex
+{
+    namespace
+    {
+        // Small chunk sizes put chunk edges into every block comment spanning several lines
+        constexpr std::string_view fixed_scripts[]
+        {
+            "",
+            "\n\n\n",
+            "a: int = 1;\n/* one\ntwo\nthree */ b: int = 2;\n",
+            "x = 1;\n/* never\nclosed\ny = 2;\n",
+            "/*\n*/\n/*\n\n*/ */ def f(): void {}\n",
+            "c = 3; /* closed on the last line */",
+            "d = 4;\n// line comment /* not a block\ne = 5;\n/*\n",
+            "2147483647 2147483648 ## ;\n/* a */ /* b\n */ z\n"
+        };
+
+        std::string random_text(std::mt19937& random, const size_t length)
+        {
+            constexpr std::string_view alphabet = "ab1 /*\n\t;=x{}#";
+            std::string text(length, ' ');
+            for (char& ch : text) ch = alphabet[random() % alphabet.size()];
+            return text;
+        }
+
+        // Names are compared by their text, the ids of two tables need not agree
+        bool same_tokens(const std::vector<Token>& lhs, const NameTable& lhs_names,
+            const std::vector<Token>& rhs, const NameTable& rhs_names)
+        {
+            if (lhs.size() != rhs.size()) return false;
+            for (size_t i = 0; i < lhs.size(); i++)
+            {
+                const TokenContent& other = rhs[i].content;
+                if (lhs[i].offset != rhs[i].offset || lhs[i].content.index() != other.index()) return false;
+                const bool same = std::visit(utils::Overload
+                    {
+                        [&](const Identifier& identifier)
+                        {
+                            return lhs_names.name(identifier.name) == rhs_names.name(std::get<Identifier>(other).name);
+                        },
+                        [&](const Integer& integer) { return integer.value == std::get<Integer>(other).value; },
+                        [&](const auto& value) { return value == std::get<std::decay_t<decltype(value)>>(other); }
+                    }, lhs[i].content);
+                if (!same) return false;
+            }
+            return true;
+        }
+
+        bool same_names(const NameTable& lhs, const NameTable& rhs)
+        {
+            if (lhs.size() != rhs.size()) return false;
+            for (NameId id = 0; id < lhs.size(); id++)
+                if (lhs.name(id) != rhs.name(id)) return false;
+            return true;
+        }
+
+        bool check_parallel(const std::string_view script, const std::string_view description)
+        {
+            NameTable names;
+            const std::vector<Token> expected = Lexer(script, names).lex();
+            bool passed = true;
+            for (const size_t chunk_size : { 1, 2, 3, 5, 8, 17, 40, 100 })
+                for (const size_t thread_count : { 1, 3 })
+                {
+                    NameTable chunk_names;
+                    const std::vector<Token> tokens = lex_parallel(script, chunk_names, chunk_size, thread_count);
+                    // Equal tables and equal name texts mean that the ids are equal as well
+                    if (same_tokens(expected, names, tokens, chunk_names) && same_names(names, chunk_names)) continue;
+                    fmt::print("lex_parallel differs from Lexer::lex() on {} with chunk size {} and {} threads\n",
+                        description, chunk_size, thread_count);
+                    passed = false;
+                }
+            return passed;
+        }
+
+        // Applies random edits, which are far apart at times so that the gap moves both ways
+        bool check_relex(std::string script, std::mt19937& random, const std::string_view description)
+        {
+            NameTable names(true);
+            TokenGapBuffer tokens(Lexer(script, names).lex(), script.size());
+            for (size_t step = 0; step < 50; step++)
+            {
+                const size_t offset = random() % (script.size() + 1);
+                const size_t removed_length = std::min<size_t>(random() % 4, script.size() - offset);
+                const std::string inserted_text = random_text(random, random() % 4);
+                script.replace(offset, removed_length, inserted_text);
+                relex(tokens, script, { offset, removed_length, inserted_text }, names);
+                NameTable expected_names;
+                const std::vector<Token> expected = Lexer(script, expected_names).lex();
+                if (same_tokens(expected, expected_names, tokens.to_vector(), names)) continue;
+                fmt::print("relex differs from Lexer::lex() on {} after edit {}\n", description, step);
+                return false;
+            }
+            return true;
+        }
+    }
+
+    bool run_self_test()
+    {
+        bool passed = true;
+        std::mt19937 random(0); // Fixed seed, so that a failure can be reproduced
+        for (size_t i = 0; i < std::size(fixed_scripts); i++)
+        {
+            const std::string description = fmt::format("fixed script {}", i);
+            passed = check_parallel(fixed_scripts[i], description) && passed;
+            passed = check_relex(std::string(fixed_scripts[i]), random, description) && passed;
+        }
+        for (size_t i = 0; i < 500; i++)
+        {
+            const std::string script = random_text(random, random() % 200);
+            const std::string description = fmt::format("random script {}", i);
+            passed = check_parallel(script, description) && passed;
+            passed = check_relex(script, random, description) && passed;
+        }
+        fmt::print(passed ? "Self test passed\n" : "Self test failed\n");
+        return passed;
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+namespace cls::lex
+{
+    // Checks that lex_parallel and relex give exactly the tokens of Lexer::lex() on fixed and
+    // random scripts, prints the cases that differ and returns whether all of them matched
+    bool run_self_test();
+}
@@ -0,0 +1,63 @@
+#include "token_buffer.h"
+#include <stdexcept>
+#include <type_traits>
+
+namespace cls::lex
+{
+    namespace
+    {
+        template <typename T, size_t I = 0>
+        constexpr uint8_t kind_of()
+        {
+            if constexpr (std::is_same_v<std::variant_alternative_t<I, TokenContent>, T>)
+                return uint8_t(I);
+            else
+                return kind_of<T, I + 1>();
+        }
+    }
+
+    TokenBuffer::TokenBuffer(Lexer& lexer) :script_(lexer.script())
+    {
+        Token token;
+        do
+        {
+            token = lexer.next();
+            push_back(token);
+        } while (!std::holds_alternative<std::monostate>(token.content));
+    }
+
+    void TokenBuffer::push_back(const Token& token)
+    {
+        if (token.offset > UINT32_MAX) throw std::length_error("Script too large for a token buffer");
+        uint32_t payload = 0;
+        switch (token.content.index())
+        {
+            case kind_of<Symbol>(): payload = uint32_t(std::get<Symbol>(token.content)); break;
+            case kind_of<Keyword>(): payload = uint32_t(std::get<Keyword>(token.content)); break;
+            case kind_of<Identifier>(): payload = std::get<Identifier>(token.content).name; break;
+            case kind_of<Integer>(): payload = uint32_t(std::get<Integer>(token.content).value); break;
+            case kind_of<LexError>(): payload = uint32_t(std::get<LexError>(token.content)); break;
+            default: break;
+        }
+        kinds_.push_back(uint8_t(token.content.index()));
+        payloads_.push_back(payload);
+        offsets_.push_back(uint32_t(token.offset));
+    }
+
+    Token TokenBuffer::operator[](const size_t index) const
+    {
+        Token token;
+        token.offset = offsets_[index];
+        const uint32_t payload = payloads_[index];
+        switch (kinds_[index])
+        {
+            case kind_of<Symbol>(): token.content = Symbol(payload); break;
+            case kind_of<Keyword>(): token.content = Keyword(payload); break;
+            case kind_of<Identifier>(): token.content = Identifier{ payload }; break;
+            case kind_of<Integer>(): token.content = Integer{ int32_t(payload) }; break;
+            case kind_of<LexError>(): token.content = LexError(payload); break;
+            default: token.content = std::monostate{}; break;
+        }
+        return token;
+    }
+}
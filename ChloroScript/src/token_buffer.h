@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "lexer.h"
+
+namespace cls::lex
+{
+    // Tokens of a whole script stored as a struct of arrays, 9 bytes per token instead of a full Token.
+    // The payload is the enumerator for symbols, keywords and errors, the name id for identifiers
+    // and the value for integers. Positions can be resolved from the byte offsets with a LineIndex.
+    class TokenBuffer final
+    {
+    private:
+        std::string_view script_;
+        std::vector<uint8_t> kinds_; // Index of the alternative in TokenContent
+        std::vector<uint32_t> payloads_;
+        std::vector<uint32_t> offsets_;
+    public:
+        explicit TokenBuffer(const std::string_view script) :script_(script) {}
+        explicit TokenBuffer(Lexer& lexer); // Lexes the whole script, the end of stream token included
+        void push_back(const Token& token);
+        Token operator[](size_t index) const;
+        size_t kind(const size_t index) const { return kinds_[index]; }
+        uint32_t payload(const size_t index) const { return payloads_[index]; }
+        size_t offset(const size_t index) const { return offsets_[index]; }
+        size_t size() const { return kinds_.size(); }
+        std::string_view script() const { return script_; }
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cls::utils
+{
+    // A bump allocator for objects that die together, e.g. the nodes of a syntax tree.
+    // Memory comes from blocks of growing size, objects with non-trivial destructors are
+    // recorded and destroyed one by one in reverse order when the arena is released,
+    // so freeing a deep tree does not recurse.
+    class Arena final
+    {
+    private:
+        struct Destructor final
+        {
+            void* object = nullptr;
+            void (*destroy)(void*) = nullptr;
+        };
+        static constexpr size_t first_block_size = 4096;
+        std::vector<std::unique_ptr<std::byte[]>> blocks_;
+        std::byte* current_ = nullptr;
+        size_t left_ = 0;
+        size_t next_block_size_ = first_block_size;
+        std::vector<Destructor> destructors_;
+
+        static size_t padding_of(const std::byte* pointer, const size_t alignment)
+        {
+            return (alignment - reinterpret_cast<uintptr_t>(pointer) % alignment) % alignment;
+        }
+
+        void* allocate(const size_t size, const size_t alignment)
+        {
+            if (!current_ || padding_of(current_, alignment) + size > left_)
+            {
+                const size_t block_size = std::max(next_block_size_, size + alignment);
+                current_ = blocks_.emplace_back(std::make_unique<std::byte[]>(block_size)).get();
+                left_ = block_size;
+                next_block_size_ *= 2;
+            }
+            const size_t padding = padding_of(current_, alignment);
+            void* result = current_ + padding;
+            current_ += padding + size;
+            left_ -= padding + size;
+            return result;
+        }
+
+    public:
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        Arena(Arena&& other) noexcept { *this = std::move(other); }
+        Arena& operator=(Arena&& other) noexcept
+        {
+            if (this == &other) return *this;
+            release();
+            blocks_ = std::move(other.blocks_);
+            destructors_ = std::move(other.destructors_);
+            current_ = std::exchange(other.current_, nullptr);
+            left_ = std::exchange(other.left_, 0);
+            next_block_size_ = std::exchange(other.next_block_size_, first_block_size);
+            other.blocks_.clear();
+            other.destructors_.clear();
+            return *this;
+        }
+        ~Arena() noexcept { release(); }
+
+        template <typename T, typename... Args>
+        T* create(Args&&... args)
+        {
+            void* memory = allocate(sizeof(T), alignof(T));
+            if constexpr (std::is_trivially_destructible_v<T>)
+                return new(memory) T(std::forward<Args>(args)...);
+            else
+            {
+                Destructor& destructor = destructors_.emplace_back(); // Reserved first, so that recording cannot fail
+                try
+                {
+                    T* object = new(memory) T(std::forward<Args>(args)...);
+                    destructor = { object, [](void* pointer) { static_cast<T*>(pointer)->~T(); } };
+                    return object;
+                }
+                catch (...)
+                {
+                    destructors_.pop_back();
+                    throw;
+                }
+            }
+        }
+
+        // Destroys all the objects and frees the memory
+        void release() noexcept
+        {
+            for (auto iter = destructors_.rbegin(); iter != destructors_.rend(); ++iter)
+                iter->destroy(iter->object);
+            destructors_.clear();
+            blocks_.clear();
+            current_ = nullptr;
+            left_ = 0;
+            next_block_size_ = first_block_size;
+        }
+    };
+}
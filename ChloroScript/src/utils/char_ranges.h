@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include "static_char_set.h"
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define CLS_CHAR_RANGES_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define CLS_CHAR_RANGES_SSE2
+#endif
+#if defined(_MSC_VER) && (defined(CLS_CHAR_RANGES_AVX2) || defined(CLS_CHAR_RANGES_SSE2))
+#   include <intrin.h>
+#endif
+
+namespace cls::utils
+{
+    namespace detail
+    {
+        inline size_t count_trailing_zeros(const uint32_t mask)
+        {
+#if defined(_MSC_VER)
+            unsigned long index = 0;
+            _BitScanForward(&index, mask);
+            return size_t(index);
+#else
+            return size_t(__builtin_ctz(mask));
+#endif
+        }
+    }
+
+    // A set of characters stored as a few byte ranges, which can be tested against 16 (SSE2)
+    // or 32 (AVX2) bytes at once to skip over long runs of the set, e.g. whitespace or comments
+    class CharRanges final
+    {
+    public:
+        static constexpr size_t max_ranges = 8;
+        struct Range final
+        {
+            uint8_t first = 0;
+            uint8_t last = 0;
+        };
+    private:
+        std::array<Range, max_ranges> ranges_{};
+        size_t count_ = 0;
+        StaticCharSet set_;
+
+        template <bool Contained>
+        const char* scan(const char* first, const char* last) const;
+    public:
+        constexpr CharRanges(const StaticCharSet& set) :set_(set) // NOLINT
+        {
+            for (size_t i = 0; i < 256; i++)
+            {
+                if (!set.contains(char(i))) continue;
+                if (count_ != 0 && ranges_[count_ - 1].last + 1u == i)
+                {
+                    ranges_[count_ - 1].last = uint8_t(i);
+                    continue;
+                }
+                if (count_ == max_ranges) throw std::logic_error("Too many ranges in the character set");
+                ranges_[count_++] = { uint8_t(i), uint8_t(i) };
+            }
+        }
+        constexpr CharRanges(const std::initializer_list<Range> ranges)
+        {
+            if (ranges.size() > max_ranges) throw std::logic_error("Too many ranges in the character set");
+            for (const auto& range : ranges)
+            {
+                ranges_[count_++] = range;
+                for (size_t ch = range.first; ch <= range.last; ch++) set_.insert(char(ch));
+            }
+        }
+        constexpr bool contains(const char ch) const { return set_.contains(ch); }
+        // Pointer to the first character in [first, last) that is not in the set, or last
+        const char* skip(const char* first, const char* last) const { return scan<true>(first, last); }
+        // Pointer to the first character in [first, last) that is in the set, or last
+        const char* find(const char* first, const char* last) const { return scan<false>(first, last); }
+    };
+
+    template <bool Contained>
+    const char* CharRanges::scan(const char* first, const char* last) const
+    {
+#if defined(CLS_CHAR_RANGES_AVX2)
+        while (last - first >= 32)
+        {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            __m256i in_set = _mm256_setzero_si256();
+            for (size_t i = 0; i < count_; i++)
+            {
+                // x in [lo, hi] <=> max(x - lo, hi - lo) == hi - lo as unsigned bytes
+                const auto [lo, hi] = ranges_[i];
+                const __m256i offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(char(lo)));
+                const __m256i limit = _mm256_set1_epi8(char(hi - lo));
+                in_set = _mm256_or_si256(in_set, _mm256_cmpeq_epi8(_mm256_max_epu8(offset, limit), limit));
+            }
+            uint32_t mask = uint32_t(_mm256_movemask_epi8(in_set));
+            if constexpr (Contained) mask = ~mask;
+            if (mask != 0) return first + detail::count_trailing_zeros(mask);
+            first += 32;
+        }
+#elif defined(CLS_CHAR_RANGES_SSE2)
+        while (last - first >= 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            __m128i in_set = _mm_setzero_si128();
+            for (size_t i = 0; i < count_; i++)
+            {
+                // x in [lo, hi] <=> max(x - lo, hi - lo) == hi - lo as unsigned bytes
+                const auto [lo, hi] = ranges_[i];
+                const __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(char(lo)));
+                const __m128i limit = _mm_set1_epi8(char(hi - lo));
+                in_set = _mm_or_si128(in_set, _mm_cmpeq_epi8(_mm_max_epu8(offset, limit), limit));
+            }
+            uint32_t mask = uint32_t(_mm_movemask_epi8(in_set));
+            if constexpr (Contained) mask = ~mask & 0xffffu;
+            if (mask != 0) return first + detail::count_trailing_zeros(mask);
+            first += 16;
+        }
+#endif
+        while (first != last && set_.contains(*first) == Contained) ++first;
+        return first;
+    }
+}
@@ -0,0 +1,113 @@
+#include "source_manager.h"
+#include <stdexcept>
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace cls::utils
+{
+    class SourceManager::MappedFile final
+    {
+    private:
+        std::string path_;
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        [[noreturn]] void fail(const char* reason) const
+        {
+            throw std::runtime_error("Failed to map file " + path_ + ": " + reason);
+        }
+    public:
+        explicit MappedFile(std::string path);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() noexcept;
+        std::string_view text() const { return { data_, size_ }; }
+        const std::string& path() const { return path_; }
+    };
+
+#if defined(_WIN32)
+    SourceManager::MappedFile::MappedFile(std::string path) :path_(std::move(path))
+    {
+        const HANDLE file = CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) fail("cannot open the file");
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            fail("cannot get the file size");
+        }
+        if (uint64_t(size.QuadPart) > uint64_t(SIZE_MAX))
+        {
+            CloseHandle(file);
+            fail("the file does not fit into the address space");
+        }
+        size_ = size_t(size.QuadPart);
+        if (size_ == 0) // Empty files cannot be mapped
+        {
+            CloseHandle(file);
+            return;
+        }
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file); // The mapping keeps the file open
+        if (!mapping) fail("cannot create the file mapping");
+        data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping); // The view keeps the mapping alive
+        if (!data_) fail("cannot map a view of the file");
+    }
+
+    SourceManager::MappedFile::~MappedFile() noexcept
+    {
+        if (data_) UnmapViewOfFile(data_);
+    }
+#else
+    SourceManager::MappedFile::MappedFile(std::string path) :path_(std::move(path))
+    {
+        const int file = ::open(path_.c_str(), O_RDONLY);
+        if (file == -1) fail("cannot open the file");
+        struct stat status {};
+        if (fstat(file, &status) == -1)
+        {
+            close(file);
+            fail("cannot get the file size");
+        }
+        size_ = size_t(status.st_size);
+        if (size_ == 0) // Empty files cannot be mapped
+        {
+            close(file);
+            return;
+        }
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file); // The mapping keeps the file open
+        if (data == MAP_FAILED) fail("cannot map the file");
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(data);
+    }
+
+    SourceManager::MappedFile::~MappedFile() noexcept
+    {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+
+    SourceManager::SourceManager() = default;
+
+    SourceManager::~SourceManager() noexcept = default;
+
+    FileId SourceManager::open(const std::string& path)
+    {
+        files_.emplace_back(std::make_unique<MappedFile>(path));
+        return FileId(files_.size() - 1);
+    }
+
+    std::string_view SourceManager::text(const FileId id) const { return files_[id]->text(); }
+
+    const std::string& SourceManager::path(const FileId id) const { return files_[id]->path(); }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 
 namespace cls::utils
 {
@@ -15,11 +16,12 @@ namespace cls::utils
         {
             while (*chars)
             {
-                data_[size_t(*chars)] = true;
+                insert(*chars);
                 chars++;
             }
         }
-        constexpr bool contains(const char ch) const { return data_[size_t(ch)]; }
+        constexpr void insert(const char ch) { data_[uint8_t(ch)] = true; }
+        constexpr bool contains(const char ch) const { return data_[uint8_t(ch)]; }
         constexpr StaticCharSet& operator|=(const StaticCharSet& other)
         {
             for (size_t i = 0; i < 256; i++) 
@@ -1,27 +1,92 @@
 #include <fmt/format.h>
-#include <fstream>
+#include <charconv>
 #include <chrono>
+#include "src/benchmark.h"
 #include "src/functions.h"
+#include "src/self_test.h"
+#include "src/source_manager.h"
 
 int main(const int argc, const char** argv)
 {
     using namespace std::literals;
     using namespace cls::lalr;
     using Clock = std::chrono::high_resolution_clock;
-    if (argc != 3)
+    if (argc == 2 && argv[1] == "--self-test"sv) return run_self_test() ? 0 : 1;
+    std::vector<std::string> paths;
+    LookaheadEngine engine = LookaheadEngine::merge;
+    bool verify = false, print_stats = false;
+    size_t thread_count = 1;
+    CodeOptions options;
+    std::string benchmark_path;
+    BenchmarkOptions benchmark;
+    for (int i = 1; i < argc; i++)
     {
-        fmt::print("Usage: LALRParser.exe grammar_path output_path\n");
+        const std::string_view arg = argv[i];
+        if (arg == "--engine=merge"sv) engine = LookaheadEngine::merge;
+        else if (arg == "--engine=deremer-pennello"sv) engine = LookaheadEngine::deremer_pennello;
+        else if (arg == "--verify-engines"sv) verify = true;
+        else if (arg == "--stats"sv) print_stats = true;
+        else if (arg == "--compressed-tables"sv) options.format = TableFormat::compressed;
+        else if (arg == "--strict-errors"sv) options.strict_errors = true;
+        else if (arg == "--arena-ast"sv) options.arena_ast = true;
+        else if (arg == "--flat-ast"sv) options.flat_ast = true;
+        else if (arg.substr(0, 12) == "--benchmark="sv) benchmark_path = arg.substr(12);
+        else if (arg.substr(0, 16) == "--build-command="sv) benchmark.build_command = arg.substr(16);
+        else if (arg.substr(0, 14) == "--run-command="sv) benchmark.run_command = arg.substr(14);
+        else if (arg.substr(0, 10) == "--threads="sv &&
+            std::from_chars(arg.data() + 10, arg.data() + arg.size(), thread_count).ptr == arg.data() + arg.size()) {}
+        else if (arg.substr(0, 2) != "--"sv) paths.emplace_back(arg);
+        else
+        {
+            paths.clear();
+            break;
+        }
+    }
+    const bool valid_paths = benchmark_path.empty() ? paths.size() == 2 :
+        paths.size() == 1 || paths.size() == 2;
+    if (!valid_paths)
+    {
+        fmt::print("Usage: LALRParser.exe [options] grammar_path output_path\n"
+            "       LALRParser.exe --benchmark=result.json [options] [grammar_path] output_path\n"
+            "       LALRParser.exe --self-test\n"
+            "Options:\n"
+            "  --engine=merge             Merge LR(1) item sets until the lookaheads settle (default)\n"
+            "  --engine=deremer-pennello  Compute the lookaheads on the LR(0) automaton\n"
+            "  --verify-engines           Run both engines and check that the tables match\n"
+            "  --stats                    Print how often item sets were visited\n"
+            "  --threads=N                Build the item sets on N threads, 0 uses all hardware threads\n"
+            "  --compressed-tables        Emit the parse table as compressed arrays instead of switches\n"
+            "  --strict-errors            Always read the lookahead before reducing\n"
+            "  --arena-ast                Allocate the pointer members of the syntax tree from an arena\n"
+            "  --flat-ast                 Store the syntax tree as arrays of nodes linked by indices\n"
+            "  --benchmark=result.json    Time the phases on synthetic grammars and write the results as JSON,\n"
+            "                             the grammar given is generated in both table formats for comparison\n"
+            "  --build-command=CMD        Time CMD after generating the grammar in each format in benchmark mode\n"
+            "  --run-command=CMD          Time CMD after the build command, e.g. parsing a large script\n");
         return 1;
     }
     try
     {
+        if (!benchmark_path.empty())
+        {
+            benchmark.engine = engine;
+            benchmark.thread_count = thread_count;
+            if (paths.size() == 2) benchmark.grammar_path = paths[0];
+            run_benchmark(benchmark_path, paths.back(), benchmark);
+            return 0;
+        }
         const auto start = Clock::now();
-        std::ifstream stream(argv[1]);
-        std::string file, line;
-        while (std::getline(stream, line)) file += line + '\n';
-        const Grammar grammar = process_input(file);
-        const std::vector<TableRow>& table = generate_table(grammar);
-        generate_code(argv[2], grammar, table);
+        cls::utils::SourceManager sources;
+        const Grammar grammar = process_input(sources.text(sources.open(paths[0])));
+        TableStats stats;
+        const std::vector<TableRow>& table = verify ?
+            generate_verified_table(grammar, &stats, thread_count) : generate_table(grammar, engine, &stats, thread_count);
+        if (print_stats)
+            fmt::print("Item sets: {} states, {} visits, {} revisits\n"
+                "Closure items: {}\nUnit shortcuts: {}\n", table.size(),
+                stats.item_set_visits, stats.item_set_revisits, stats.closure_items, stats.unit_shortcuts);
+        generate_code(paths[1], grammar, table, options);
+        generate_lexer(paths[1], grammar);
         const auto us = (Clock::now() - start) / 1us;
         fmt::print("Completed - Elapsed {}us\n", us);
         return 0;
@@ -0,0 +1,292 @@
+#include "benchmark.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include "functions.h"
+#include "perfect_hash.h"
+#include "source_manager.h"
+#include "utils.h"
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#   include <Psapi.h>
+#   pragma comment(lib, "psapi.lib")
+#else
+#   include <sys/resource.h>
+#endif
+
+namespace cls::lalr
+{
+    using namespace utils;
+
+    namespace
+    {
+        // Peak resident memory of the process so far in bytes, the operating systems offer no way
+        // to reset it so the cases run from the smallest grammar to the largest
+        size_t peak_memory()
+        {
+#if defined(_WIN32)
+            PROCESS_MEMORY_COUNTERS counters{};
+            if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+            return counters.PeakWorkingSetSize;
+#else
+            rusage usage{};
+            if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#   if defined(__APPLE__)
+            return size_t(usage.ru_maxrss);
+#   else
+            return size_t(usage.ru_maxrss) * 1024; // In kilobytes
+#   endif
+#endif
+        }
+
+        // A grammar with levels binary operators and statement_kinds kinds of statements holding
+        // expressions, blocks and argument lists. The operators either form a chain of one non-terminal
+        // per precedence level, or are alternatives of a single one ordered by %left and %right.
+        std::string synthetic_grammar(const size_t levels, const size_t statement_kinds, const bool precedence)
+        {
+            std::string text;
+            const auto out = std::back_inserter(text);
+            fmt::format_to(out, "Symbol\n{{\n    left_paren \"(\", right_paren \")\", semicolon \";\", comma \",\",\n"
+                "    left_brace \"{{\", right_brace \"}}\", equal \"=\"");
+            for (size_t i = 0; i < levels; i++) fmt::format_to(out, ",\n    op{0} \"@{0}\"", i);
+            fmt::format_to(out, "\n}},\nKeyword\n{{");
+            for (size_t i = 0; i < statement_kinds; i++) fmt::format_to(out, "{0}\n    kw{1} \"k{1}\"", i == 0 ? "" : ",", i);
+            fmt::format_to(out, "\n}},\nIdentifier /[A-Za-z_][A-Za-z_0-9]*/, Integer /[0-9]+/,\nLexError, $\n\n");
+            if (precedence)
+            {
+                for (size_t i = 0; i < levels; i++) // Every third level is right associative, like assignments
+                    fmt::format_to(out, "%{} Symbol.op{};\n", i % 3 == 2 ? "right" : "left", i);
+                fmt::format_to(out, "\n");
+            }
+
+            const std::string expr = precedence ? "E" : "E0";
+            fmt::format_to(out, "Program: Stmts(stmts);\n");
+            fmt::format_to(out, "Stmts: Stmts...(stmts) Stmt(stmt);\n     | ;\n");
+            for (size_t i = 0; i < statement_kinds; i++)
+            {
+                fmt::format_to(out, "{} [S{}] Keyword.kw{} ", i == 0 ? "Stmt:" : "    |", i, i);
+                switch (i % 3)
+                {
+                    case 0: fmt::format_to(out, "Identifier(name) Symbol.equal {}*(value) Symbol.semicolon;\n", expr); break;
+                    case 1: fmt::format_to(out, "Symbol.left_brace Stmts*(body) Symbol.right_brace;\n"); break;
+                    default: fmt::format_to(out, "Symbol.left_paren Args(args) Symbol.right_paren Symbol.semicolon;\n");
+                }
+            }
+            fmt::format_to(out, "Args: [Some] {}*(first) ArgTail(rest);\n    | [Empty];\n", expr);
+            fmt::format_to(out, "ArgTail: ArgTail...(args) Symbol.comma {}*(arg);\n       | ;\n", expr);
+            if (precedence)
+                for (size_t i = 0; i < levels; i++)
+                    fmt::format_to(out, "{} [Op{}] E*(lhs) Symbol.op{} E*(rhs);\n", i == 0 ? "E:" : "  |", i, i);
+            else
+                for (size_t i = 0; i < levels; i++)
+                    fmt::format_to(out, "E{0}: [Op] E{0}*(lhs) Symbol.op{0} E{1}*(rhs);\n    | [Next] E{1}(expr);\n", i, i + 1);
+            if (precedence) fmt::format_to(out, "  |");
+            else fmt::format_to(out, "E{}:", levels);
+            fmt::format_to(out, " [Int] Integer(value);\n    | [Name] Identifier(name);\n"
+                "    | [Call] Identifier(callee) Symbol.left_paren Args(args) Symbol.right_paren;\n"
+                "    | [Paren] Symbol.left_paren {}*(expr) Symbol.right_paren;\n", expr);
+            return text;
+        }
+
+        struct BenchmarkCase final
+        {
+            std::string name;
+            size_t levels = 0;
+            size_t statement_kinds = 0;
+            bool precedence = false;
+            CodeOptions options;
+        };
+
+        std::vector<BenchmarkCase> benchmark_cases()
+        {
+            std::vector<BenchmarkCase> cases;
+            // Every grammar is also generated with compressed tables to compare the code sizes
+            const auto add = [&cases](const std::string& name, const size_t levels,
+                const size_t statement_kinds, const bool precedence = false)
+            {
+                cases.push_back({ name, levels, statement_kinds, precedence, CodeOptions{} });
+                cases.push_back({ name + "_compressed", levels, statement_kinds, precedence, { TableFormat::compressed } });
+            };
+            for (size_t levels = 8; levels <= 64; levels *= 2) // Deep expression grammars
+                add(fmt::format("expression_ladder_{}", levels), levels, 3);
+            for (size_t levels = 8; levels <= 64; levels *= 2) // The same operators resolved by precedence
+                add(fmt::format("expression_precedence_{}", levels), levels, 3, true);
+            for (size_t kinds = 32; kinds <= 256; kinds *= 2) // Long lists of alternatives
+                add(fmt::format("statement_list_{}", kinds), 1, kinds);
+            add("c_sized", 15, 64); // About as many precedence levels and statements as C
+            add("c_sized_precedence", 15, 64, true);
+            // The other outputs of the C sized grammar, the default one takes the unit shortcuts
+            CodeOptions strict, arena, flat;
+            strict.strict_errors = true;
+            arena.arena_ast = true;
+            flat.flat_ast = true;
+            cases.push_back({ "c_sized_strict", 15, 64, false, strict });
+            cases.push_back({ "c_sized_arena", 15, 64, false, arena });
+            cases.push_back({ "c_sized_flat", 15, 64, false, flat });
+            return cases;
+        }
+
+        struct KeywordLookup final
+        {
+            size_t keywords = 0;
+            double perfect_hash_ns = 0; // Per lookup, as the generated lexer resolves reserved words
+            double linear_scan_ns = 0; // Per lookup, comparing against every keyword in turn
+        };
+
+        // Looks up every keyword and as many identifiers that are not keywords
+        template <size_t N>
+        KeywordLookup time_keyword_lookup()
+        {
+            using Clock = std::chrono::steady_clock;
+            constexpr size_t lookup_count = size_t(1) << 20;
+            std::vector<std::string> names;
+            for (size_t i = 0; i < N; i++) names.emplace_back(fmt::format("keyword{}", i));
+            for (size_t i = 0; i < N; i++) names.emplace_back(fmt::format("identifier{}", i));
+            std::pair<std::string_view, size_t> entries[N];
+            for (size_t i = 0; i < N; i++) entries[i] = { names[i], i };
+            const PerfectHashMap map(entries);
+            const auto time = [&](auto&& find)
+            {
+                size_t found = 0;
+                const auto start = Clock::now();
+                for (size_t i = 0; i < lookup_count; i++)
+                    found += find(std::string_view(names[i % names.size()]));
+                const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+                if (found != lookup_count / 2) error("Keyword lookup benchmark found {} keywords", found);
+                return elapsed.count() / lookup_count;
+            };
+            KeywordLookup result{ N };
+            result.perfect_hash_ns = time([&](const std::string_view name) { return map.find(name) != nullptr; });
+            result.linear_scan_ns = time([&](const std::string_view name)
+            {
+                return std::any_of(std::begin(entries), std::end(entries),
+                    [name](const auto& entry) { return entry.first == name; });
+            });
+            return result;
+        }
+
+        template <size_t... Ns>
+        std::vector<KeywordLookup> keyword_lookups(std::index_sequence<Ns...>)
+        {
+            return { time_keyword_lookup<size_t(4) << Ns * 2>()... }; // 4 to 1024 keywords
+        }
+
+        size_t code_bytes(const std::string& output_path)
+        {
+            return size_t(std::filesystem::file_size(output_path + "parser.h")
+                + std::filesystem::file_size(output_path + "parser.cpp"));
+        }
+
+        // Wall time of the command in milliseconds
+        double time_command(const std::string& command)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            if (const int status = std::system(command.c_str()); status != 0)
+                error("Benchmark command \"{}\" failed with status {}", command, status);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return elapsed.count();
+        }
+
+        struct FormatComparison final
+        {
+            const char* format = "";
+            size_t code_bytes = 0;
+            double build_ms = 0; // Zero without a build command
+            double run_ms = 0; // The fastest of three runs, zero without a run command
+        };
+
+        // The switches go last, so that the parser left in output_path is the default one
+        std::vector<FormatComparison> compare_formats(const std::string& output_path, const BenchmarkOptions& options)
+        {
+            SourceManager sources;
+            const Grammar grammar = process_input(sources.text(sources.open(options.grammar_path)));
+            const std::vector<TableRow> table = generate_table(grammar, options.engine, nullptr, options.thread_count);
+            std::vector<FormatComparison> results;
+            for (const TableFormat format : { TableFormat::compressed, TableFormat::switches })
+            {
+                generate_code(output_path, grammar, table, { format });
+                generate_lexer(output_path, grammar);
+                FormatComparison& result = results.emplace_back();
+                result.format = format == TableFormat::switches ? "switches" : "compressed";
+                result.code_bytes = code_bytes(output_path);
+                if (!options.build_command.empty()) result.build_ms = time_command(options.build_command);
+                if (!options.run_command.empty())
+                {
+                    result.run_ms = time_command(options.run_command);
+                    for (size_t i = 0; i < 2; i++) result.run_ms = std::min(result.run_ms, time_command(options.run_command));
+                }
+            }
+            return results;
+        }
+    }
+
+    void run_benchmark(const std::string& json_path, const std::string& output_path, const BenchmarkOptions& options)
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto us = [](const Clock::duration duration)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        };
+        std::ofstream stream(json_path);
+        if (stream.fail()) error("Failed to open text file {}", json_path);
+        const auto out = std::ostreambuf_iterator(stream);
+        fmt::format_to(out, "{{\n  \"engine\": \"{}\",\n  \"threads\": {},\n  \"cases\": [",
+            options.engine == LookaheadEngine::merge ? "merge" : "deremer-pennello", options.thread_count);
+        for (const auto [i, test] : enumerate(benchmark_cases()))
+        {
+            const std::string text = synthetic_grammar(test.levels, test.statement_kinds, test.precedence);
+            const auto start = Clock::now();
+            const Grammar grammar = process_input(text);
+            const auto parsed = Clock::now();
+            TableStats stats;
+            const std::vector<TableRow> table = generate_table(grammar, options.engine, &stats, options.thread_count);
+            const auto generated = Clock::now();
+            generate_code(output_path, grammar, table, test.options);
+            const auto written = Clock::now();
+            fmt::print("{}: {} states, {}us\n", test.name, table.size(), us(written - start));
+            fmt::format_to(out, "{}\n    {{\n"
+                "      \"name\": \"{}\",\n"
+                "      \"states\": {},\n"
+                "      \"unit_shortcuts\": {},\n"
+                "      \"process_input_us\": {},\n"
+                "      \"compute_first_set_us\": {},\n"
+                "      \"compute_item_sets_us\": {},\n"
+                "      \"fill_table_us\": {},\n"
+                "      \"generate_table_us\": {},\n"
+                "      \"generate_code_us\": {},\n"
+                "      \"code_bytes\": {},\n"
+                "      \"peak_memory_bytes\": {}\n"
+                "    }}", i == 0 ? "" : ",", test.name, table.size(), stats.unit_shortcuts, us(parsed - start),
+                us(stats.first_set_time), us(stats.item_set_time), us(stats.fill_time),
+                us(generated - parsed), us(written - generated), code_bytes(output_path), peak_memory());
+        }
+        // After the timed cases, the peak memory would include the other engine otherwise
+        for (const BenchmarkCase& test : benchmark_cases())
+            generate_verified_table(process_input(synthetic_grammar(test.levels, test.statement_kinds, test.precedence)),
+                nullptr, options.thread_count);
+        fmt::print("Lookahead engines agree on every case\n");
+        fmt::format_to(out, "\n  ],\n  \"engines_agree\": true,\n  \"table_formats\": [");
+        if (!options.grammar_path.empty())
+            for (const auto [i, result] : enumerate(compare_formats(output_path, options)))
+            {
+                fmt::print("{}: {} bytes, built in {:.0f}ms, ran in {:.1f}ms\n",
+                    result.format, result.code_bytes, result.build_ms, result.run_ms);
+                fmt::format_to(out, "{}\n    {{ \"format\": \"{}\", \"code_bytes\": {}, \"build_ms\": {:.1f}, \"run_ms\": {:.1f} }}",
+                    i == 0 ? "" : ",", result.format, result.code_bytes, result.build_ms, result.run_ms);
+            }
+        fmt::format_to(out, "\n  ],\n  \"keyword_lookup\": [");
+        for (const auto [i, lookup] : enumerate(keyword_lookups(std::make_index_sequence<5>{})))
+        {
+            fmt::print("keyword_lookup_{}: {:.1f}ns perfect hash, {:.1f}ns linear scan\n",
+                lookup.keywords, lookup.perfect_hash_ns, lookup.linear_scan_ns);
+            fmt::format_to(out, "{}\n    {{ \"keywords\": {}, \"perfect_hash_ns\": {:.2f}, \"linear_scan_ns\": {:.2f} }}",
+                i == 0 ? "" : ",", lookup.keywords, lookup.perfect_hash_ns, lookup.linear_scan_ns);
+        }
+        fmt::format_to(out, "\n  ]\n}}\n");
+    }
+}
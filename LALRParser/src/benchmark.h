@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include "types.h"
+
+namespace cls::lalr
+{
+    struct BenchmarkOptions final
+    {
+        LookaheadEngine engine = LookaheadEngine::merge;
+        size_t thread_count = 1;
+        // A real grammar whose parser is generated in both table formats, skipped if empty
+        std::string grammar_path;
+        // Run through std::system after generating the grammar in each format, the build command
+        // should compile the parser and the run command parse a large script with it
+        std::string build_command;
+        std::string run_command;
+    };
+
+    // Runs the generator on synthetic grammars of growing size and writes the time spent in
+    // each phase, the size of the generated code and the peak memory to a JSON file, the generated
+    // code goes to output_path. Then checks that both lookahead engines build the same tables for
+    // every grammar, compares the table formats on the real grammar and times keyword lookups
+    // in the perfect hash table of the generated lexer.
+    void run_benchmark(const std::string& json_path, const std::string& output_path, const BenchmarkOptions& options);
+}
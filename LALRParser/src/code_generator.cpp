@@ -1,5 +1,8 @@
 #include "functions.h"
 #include <fstream>
+#include <map>
+#include <numeric>
+#include <unordered_map>
 #include "utils.h"
 #include "overload.h"
 
@@ -62,6 +65,64 @@ namespace cls::lalr
             return result;
         }
 
+        /* Table compression */
+
+        // Row displacement: entry (i, j) of a sparse table is stored at base[i] + j of a shared
+        // vector, and check holds the row owning each slot so that the rows can interleave
+        struct CombVector final
+        {
+            std::vector<size_t> base;
+            std::vector<size_t> values;
+            std::vector<size_t> check;
+        };
+
+        // rows[i] holds the (column, value) pairs of row i, the vector covers base + column for every
+        // column below width, slots not owned by any row are checked against rows.size()
+        CombVector compress_rows(const std::vector<std::vector<std::pair<size_t, size_t>>>& rows, const size_t width)
+        {
+            const size_t no_owner = rows.size();
+            CombVector comb{ std::vector<size_t>(rows.size(), 0), {}, {} };
+            std::vector<size_t> order(rows.size());
+            std::iota(order.begin(), order.end(), size_t(0));
+            std::stable_sort(order.begin(), order.end(), // Denser rows are harder to fit, place them first
+                [&](const size_t lhs, const size_t rhs) { return rows[lhs].size() > rows[rhs].size(); });
+            const auto is_free = [&](const size_t slot) { return slot >= comb.check.size() || comb.check[slot] == no_owner; };
+            size_t first_free = 0;
+            for (const size_t row : order)
+            {
+                const auto& entries = rows[row];
+                if (entries.empty()) continue; // Never owns a slot, the default is always taken
+                const size_t first_column = entries.front().first;
+                size_t base = first_free > first_column ? first_free - first_column : 0;
+                while (!std::all_of(entries.begin(), entries.end(),
+                    [&](const auto& entry) { return is_free(base + entry.first); })) base++;
+                comb.base[row] = base;
+                for (const auto& [column, value] : entries)
+                {
+                    if (base + column >= comb.check.size())
+                    {
+                        comb.values.resize(base + column + 1, 0);
+                        comb.check.resize(base + column + 1, no_owner);
+                    }
+                    comb.values[base + column] = value;
+                    comb.check[base + column] = row;
+                }
+                while (!is_free(first_free)) first_free++;
+            }
+            const size_t size = *std::max_element(comb.base.begin(), comb.base.end()) + width;
+            comb.values.resize(size, 0);
+            comb.check.resize(size, no_owner);
+            return comb;
+        }
+
+        std::string_view unsigned_type(const size_t max_value)
+        {
+            if (max_value <= UINT8_MAX) return "uint8_t";
+            if (max_value <= UINT16_MAX) return "uint16_t";
+            if (max_value <= UINT32_MAX) return "uint32_t";
+            return "uint64_t";
+        }
+
         /* Code Generator */
 
         class CodeGenerator final
@@ -73,8 +134,22 @@ namespace cls::lalr
             std::ofstream source_stream_; // Source stream
             const Grammar& grammar_;
             const std::vector<TableRow>& table_;
+            CodeOptions options_;
             std::vector<std::vector<size_t>> rule_saved_term_count_;
+            std::vector<std::pair<size_t, size_t>> rule_positions_; // Non-terminal and alternative of each rule
+            std::vector<std::vector<size_t>> unit_chains_{ {} }; // Rules reduced by unit shortcuts, the first is empty
+            std::map<std::vector<size_t>, size_t> unit_chain_ids_{ { {}, 0 } };
+            std::vector<bool> skipped_states_; // Only entered by go-tos that take unit shortcuts instead
+            bool has_lists_ = false;
             bool is_enum(const Term& term) const;
+            std::string term_type(const Term& term) const;
+            std::string node_kind(size_t non_terminal, size_t rule) const;
+            bool passes_through(size_t non_terminal, size_t rule) const;
+            std::string parse_type() const;
+            std::string accept_expression() const;
+            std::pair<size_t, size_t> go_to_target(const TableRow& row, size_t non_terminal) const;
+            std::string unit_reduction(size_t rule) const;
+            std::vector<size_t> unit_chain(const UnitShortcut& shortcut) const;
             std::ofstream& stream() { return write_to_header_ ? header_stream_ : source_stream_; }
             void new_line(ptrdiff_t indent = 0);
             void open_brace(bool to_new_line = true);
@@ -86,16 +161,23 @@ namespace cls::lalr
             }
             std::vector<size_t> get_struct_define_sequence() const;
             void define_structs();
+            void define_flat_tree();
             void declare_parser_class();
             void define_parser_helpers();
+            void define_flat_parser_helpers();
             std::string pop_term(const Term& term, size_t offset) const;
             void define_reduce();
+            void define_flat_reduce();
             void define_go_to();
             std::vector<size_t> get_token_indices() const;
             void define_parse();
+            void define_array(std::string_view name, const std::vector<size_t>& values);
+            void define_tables();
+            void define_current_terminal();
+            void define_compressed_parse();
         public:
             CodeGenerator(const std::string& directory, const Grammar& grammar,
-                const std::vector<TableRow>& table);
+                const std::vector<TableRow>& table, const CodeOptions& options);
             void write_code();
         };
 
@@ -106,6 +188,52 @@ namespace cls::lalr
             return false;
         }
 
+        std::string CodeGenerator::term_type(const Term& term) const
+        {
+            return std::visit(Overload
+                {
+                    [this](const Terminal& t) { return fmt::format("lex::{}", grammar_.token_types[t.index].type_name); },
+                    [this](const NonTerminal& t)
+                    {
+                        const std::string& type = grammar_.non_terminals[t.index];
+                        if (!t.use_unique_ptr) return type;
+                        return fmt::format(options_.arena_ast ? "{}*" : "std::unique_ptr<{}>", type);
+                    }
+                }, term);
+        }
+
+        std::string CodeGenerator::node_kind(const size_t non_terminal, const size_t rule) const
+        {
+            const std::string& name = grammar_.non_terminals[non_terminal];
+            const auto& rules = grammar_.rules[non_terminal];
+            if (rules.size() == 1 || grammar_.lists[non_terminal]) return name;
+            if (!rules[rule].type_name.empty()) return fmt::format("{}_{}", name, rules[rule].type_name);
+            return fmt::format("{}_{}", name, rule);
+        }
+
+        bool CodeGenerator::passes_through(const size_t non_terminal, const size_t rule) const
+        {
+            // Alternatives holding a single unnamed term, the struct layout stores the term
+            // itself in the variant, the flat layout uses the node or token of the term
+            const auto& rules = grammar_.rules[non_terminal];
+            const Rule& current = rules[rule];
+            return !grammar_.lists[non_terminal] && rules.size() > 1 && current.type_name.empty()
+                && current.terms.size() == 1 && !is_enum(current.terms[0]);
+        }
+
+        std::string CodeGenerator::parse_type() const
+        {
+            if (options_.flat_ast) return "Tree";
+            return options_.arena_ast ? "ParseResult" : grammar_.non_terminals[1];
+        }
+
+        std::string CodeGenerator::accept_expression() const
+        {
+            if (options_.flat_ast) return "take_tree()";
+            if (options_.arena_ast) return fmt::format("{{ std::move(arena_), move_top<{}>() }}", grammar_.non_terminals[1]);
+            return fmt::format("move_top<{}>()", grammar_.non_terminals[1]);
+        }
+
         void CodeGenerator::new_line(const ptrdiff_t indent)
         {
             indent_ += indent;
@@ -135,7 +263,7 @@ namespace cls::lalr
                 for (const Rule& rule : rules)
                     for (const Term& term : rule.terms)
                         if (const NonTerminal * ptr = std::get_if<NonTerminal>(&term);
-                            ptr && !ptr->use_unique_ptr)
+                            ptr && !ptr->use_unique_ptr && !ptr->is_list)
                             graph.add_dependency(nt, ptr->index);
             return graph.topological_traversal();
         }
@@ -156,22 +284,16 @@ namespace cls::lalr
             {
                 std::visit(Overload
                     {
-                        [begin_with_new_line, this](const Terminal& t)
+                        [&, this](const Terminal& t)
                         {
-                            const TokenType& token = grammar_.token_types[t.index];
-                            if (token.enumerator) return;
+                            if (grammar_.token_types[t.index].enumerator) return;
                             if (begin_with_new_line) new_line();
-                            write("lex::{} {};", token.type_name, t.variable_name);
+                            write("{} {};", term_type(term), t.variable_name);
                         },
-                        [begin_with_new_line, this](const NonTerminal& t)
+                        [&, this](const NonTerminal& t)
                         {
-                            const std::string& type = grammar_.non_terminals[t.index];
                             if (begin_with_new_line) new_line();
-                            if (t.use_unique_ptr)
-                                write("std::unique_ptr<{}>", type);
-                            else
-                                write(type);
-                            write(" {};", t.variable_name);
+                            write("{} {};", term_type(term), t.variable_name);
                         }
                     }, term);
             };
@@ -179,6 +301,12 @@ namespace cls::lalr
             {
                 if (i == 0) continue;
                 write("struct {} final", grammar_.non_terminals[i]);
+                if (const auto& list = grammar_.lists[i]) // Elements in a vector
+                {
+                    write(" {{ std::vector<{}> {}; }};", term_type(list->element), list->variable_name);
+                    new_line();
+                    continue;
+                }
                 const auto& rules = grammar_.rules[i];
                 const auto output_class_members = [&, this](const size_t index)
                 {
@@ -248,16 +376,130 @@ namespace cls::lalr
             new_line();
         }
 
+        std::pair<size_t, size_t> CodeGenerator::go_to_target(const TableRow& row, const size_t non_terminal) const
+        {
+            // Returns the state and the index of the unit chain reduced on the way
+            if (!options_.strict_errors)
+                if (const auto iter = std::lower_bound(row.unit_shortcuts.begin(), row.unit_shortcuts.end(), non_terminal,
+                    [](const UnitShortcut& shortcut, const size_t nt) { return shortcut.non_terminal < nt; });
+                    iter != row.unit_shortcuts.end() && iter->non_terminal == non_terminal)
+                    return { iter->state, unit_chain_ids_.at(unit_chain(*iter)) };
+            return { row.go_to[non_terminal], 0 };
+        }
+
+        std::string CodeGenerator::unit_reduction(const size_t rule) const
+        {
+            // The node on top is replaced in place, as a reduction by the unit rule would do
+            const auto [nt, index] = rule_positions_[rule];
+            const Term& term = grammar_.rules[nt][index].terms[0];
+            if (!options_.flat_ast)
+                return fmt::format("node_stack_.back() = {}{{ {} }}; ", grammar_.non_terminals[nt], pop_term(term, 0));
+            if (passes_through(nt, index)) return {};
+            return fmt::format("node_stack_.back() = add_node(NodeKind::{}, {{ take(0) }}); ", node_kind(nt, index));
+        }
+
+        std::vector<size_t> CodeGenerator::unit_chain(const UnitShortcut& shortcut) const
+        {
+            // The rules of the shortcut that change the node on top
+            std::vector<size_t> rules;
+            std::copy_if(shortcut.rules.begin(), shortcut.rules.end(), std::back_inserter(rules),
+                [this](const size_t rule) { return !unit_reduction(rule).empty(); });
+            return rules;
+        }
+
+        void CodeGenerator::define_flat_tree()
+        {
+            stream() << "enum class NodeKind : uint32_t";
+            open_brace();
+            bool first = true;
+            for (const auto [i, rules] : enumerate(grammar_.rules))
+            {
+                if (i == 0) continue;
+                for (size_t j = 0; j < (grammar_.lists[i] ? 1 : rules.size()); j++)
+                {
+                    if (passes_through(i, j)) continue;
+                    if (!first) stream() << ',';
+                    if (!first) new_line();
+                    first = false;
+                    stream() << node_kind(i, j);
+                }
+            }
+            close_brace(";");
+            stream() << R"code(
+
+    struct Node final
+    {
+        NodeKind kind{};
+        uint32_t first = 0; // The children are children[first, first + count) of the tree
+        uint32_t count = 0;
+    };
+
+    // Nodes refer to their children by index, the indices of tokens have the highest bit set
+    struct Tree final
+    {
+        static constexpr uint32_t token_bit = 1u << 31;
+        std::vector<Node> nodes;
+        std::vector<uint32_t> children;
+        std::vector<lex::Token> tokens;
+        uint32_t root = 0;
+        static bool is_token(const uint32_t ref) { return ref & token_bit; }
+        const Node& node(const uint32_t ref) const { return nodes[ref]; }
+        const lex::Token& token(const uint32_t ref) const { return tokens[ref & ~token_bit]; }
+        const uint32_t* children_of(const Node& node) const { return children.data() + node.first; }
+    };)code";
+            new_line();
+        }
+
         void CodeGenerator::declare_parser_class()
         {
+            if (options_.arena_ast) // The tree comes with its arena, so that it cannot outlive the nodes
+                write(R"code(
+    struct ParseResult final
+    {{
+        utils::Arena arena;
+        {} root;
+    }};
+)code", grammar_.non_terminals[1]);
             stream() << R"code(
     class Parser final
     {
     private:
+        lex::Lexer* lexer_ = nullptr;
+        const lex::TokenBuffer* buffer_ = nullptr;
         std::vector<lex::Token> tokens_;
-        size_t input_position_ = 0;
+        std::string_view script_;
+        size_t input_position_ = 0; // The lookahead itself when reading a token buffer
+        lex::Token lookahead_; // Not used when reading a token buffer
         std::vector<size_t> state_stack_{ 0 };
-        std::vector<ASTNode> node_stack_;
+)code";
+            if (options_.flat_ast)
+                stream() << R"code(        // Terms on the stack are referred to as in Tree, unless they are pending: shifted tokens
+        // not taken by a node yet, or lists still growing
+        static constexpr uint32_t pending_bit = 1u << 30;
+        static constexpr uint32_t pending_token = Tree::token_bit | pending_bit;
+        struct PendingList final
+        {
+            NodeKind kind{};
+            std::vector<uint32_t> elements;
+        };
+        std::vector<uint32_t> node_stack_;
+        std::vector<lex::Token> token_stack_;
+        std::vector<PendingList> pending_lists_; // The storage is reused by later lists
+        size_t pending_list_count_ = 0;
+        Tree tree_;
+
+        uint32_t at(const size_t offset) const { return *(node_stack_.end() - offset - 1); }
+        uint32_t add_node(NodeKind kind, const uint32_t* children, size_t count);
+        uint32_t add_node(NodeKind kind, std::initializer_list<uint32_t> children);
+        uint32_t take(size_t offset); // Moves a growing list into the tree
+        uint32_t take_token(size_t offset); // The offset counts the pending tokens only
+        uint32_t new_list(NodeKind kind, std::initializer_list<uint32_t> elements);
+        uint32_t append(uint32_t list, uint32_t element);
+        void replace(size_t n, size_t token_count, uint32_t ref); // Replaces the top n terms by ref
+        Tree take_tree();
+)code";
+            else
+                stream() << R"code(        std::vector<ASTNode> node_stack_;
 
         template <typename T>
         T move_top(const size_t offset = 0) { return std::get<T>(std::move(*(node_stack_.end() - offset - 1))); }
@@ -268,46 +510,181 @@ namespace cls::lalr
         template <typename T>
         auto make_unique_from_top(const size_t offset = 0) { return std::make_unique<T>(move_top<T>(offset)); }
 
-        template <size_t N>
-        auto& current_token() { return std::get<N>(tokens_[input_position_].content); }
+        // Puts the node into the slot of the first of the top n terms, the ones above it are dropped
+        template <typename T>
+        void replace(const size_t n, T&& node)
+        {
+            if (n == 0)
+                node_stack_.emplace_back(std::forward<T>(node));
+            else
+            {
+                *(node_stack_.end() - n) = std::forward<T>(node);
+                node_stack_.erase(node_stack_.end() - n + 1, node_stack_.end());
+            }
+            state_stack_.erase(state_stack_.end() - n, state_stack_.end());
+        }
+)code";
+            if (options_.arena_ast)
+                stream() << R"code(
+        utils::Arena arena_;
+
+        template <typename T>
+        T* make_node_from_top(const size_t offset = 0) { return arena_.create<T>(move_top<T>(offset)); }
+)code";
+            stream() << R"code(
+        template <size_t N> // Only for enum token types
+        auto current_token() const
+        {
+            using Enum = std::variant_alternative_t<N, lex::TokenContent>;
+            return buffer_ ? Enum(buffer_->payload(input_position_)) : std::get<N>(lookahead_.content);
+        }
 
-        void error() const;
-        void pop_n(size_t n);
+        void advance();
+        lex::Token take_lookahead();
+        [[noreturn]] void error() const;
         size_t current_token_type() const;
-        size_t current_node_type() const;
         void shift(size_t new_state);
         void reduce(size_t rule);
-        void go_to();
+        void go_to(size_t non_terminal);)code";
+            if (has_lists_ && !options_.flat_ast) stream() << "\n        void pop_list_tail(size_t n);";
+            if (options_.format == TableFormat::compressed) stream() << "\n        size_t current_terminal();";
+            stream() << R"code(
     public:
-        explicit Parser(std::vector<lex::Token>&& tokens) :tokens_(std::move(tokens)) {}
+        Parser(std::vector<lex::Token>&& tokens, const std::string_view script) :
+            tokens_(std::move(tokens)), script_(script) { advance(); }
+        explicit Parser(lex::Lexer& lexer) :lexer_(&lexer), script_(lexer.script()) { advance(); } // Pulls tokens on demand
+        explicit Parser(const lex::TokenBuffer& buffer) :buffer_(&buffer), script_(buffer.script()) {}
         )code";
-            write("{} parse();\n    }};", grammar_.non_terminals[1]);
+            write("{} parse();\n    }};", parse_type());
         }
 
         void CodeGenerator::define_parser_helpers()
         {
             stream() << R"code(
-    void Parser::pop_n(const size_t n)
+    void Parser::advance()
     {
-        node_stack_.erase(node_stack_.end() - n - 1, node_stack_.end() - 1);
-        state_stack_.erase(state_stack_.end() - n, state_stack_.end());
+        if (lexer_)
+            lookahead_ = lexer_->next();
+        else if (buffer_)
+            input_position_++;
+        else
+            lookahead_ = std::move(tokens_[input_position_++]);
+    }
+
+    lex::Token Parser::take_lookahead()
+    {
+        if (!buffer_) return std::move(lookahead_);
+        // Tokens of a buffer are only built when the tree keeps them, the others are placeholders
+        if (saved_kinds[buffer_->kind(input_position_)]) return (*buffer_)[input_position_];
+        return { {}, buffer_->offset(input_position_) };
     }
 
     void Parser::error() const
     {
-        const auto [line, column] = tokens_[input_position_].position;
+        const size_t offset = buffer_ ? buffer_->offset(input_position_) : lookahead_.offset;
+        const auto [line, column] = lex::LineIndex(script_).position(offset);
         throw std::runtime_error(fmt::format("Parsing error at line {}, column {}", line, column));
     }
 
-    size_t Parser::current_token_type() const { return tokens_[input_position_].content.index(); }
+    )code";
+            if (has_lists_ && !options_.flat_ast)
+                stream() << R"code(// Pops n states and the nodes above the list that has just taken its new element
+    void Parser::pop_list_tail(const size_t n)
+    {
+        node_stack_.erase(node_stack_.end() - n + 1, node_stack_.end());
+        state_stack_.erase(state_stack_.end() - n, state_stack_.end());
+    }
 
-    size_t Parser::current_node_type() const { return node_stack_.back().index(); }
+    )code";
+            stream() << R"code(size_t Parser::current_token_type() const
+    {
+        return buffer_ ? buffer_->kind(input_position_) : lookahead_.content.index();
+    }
 
-    void Parser::shift(const size_t new_state)
+    )code";
+            if (options_.flat_ast)
+            {
+                define_flat_parser_helpers();
+                return;
+            }
+            stream() << R"code(void Parser::shift(const size_t new_state)
     {
-        node_stack_.emplace_back(std::move(tokens_[input_position_]));
+        node_stack_.emplace_back(take_lookahead());
         state_stack_.emplace_back(new_state);
-        input_position_++;
+        advance();
+    }
+
+    )code";
+        }
+
+        void CodeGenerator::define_flat_parser_helpers()
+        {
+            stream() << R"code(void Parser::shift(const size_t new_state)
+    {
+        token_stack_.emplace_back(take_lookahead());
+        node_stack_.emplace_back(pending_token);
+        state_stack_.emplace_back(new_state);
+        advance();
+    }
+
+    uint32_t Parser::add_node(const NodeKind kind, const uint32_t* children, const size_t count)
+    {
+        if (tree_.nodes.size() >= pending_bit || tree_.children.size() + count > UINT32_MAX)
+            throw std::runtime_error("The syntax tree is too large for 32-bit references");
+        tree_.nodes.push_back({ kind, uint32_t(tree_.children.size()), uint32_t(count) });
+        tree_.children.insert(tree_.children.end(), children, children + count);
+        return uint32_t(tree_.nodes.size() - 1);
+    }
+
+    uint32_t Parser::add_node(const NodeKind kind, const std::initializer_list<uint32_t> children)
+    {
+        return add_node(kind, children.begin(), children.size());
+    }
+
+    uint32_t Parser::take(const size_t offset)
+    {
+        const uint32_t ref = at(offset);
+        if ((ref & pending_token) != pending_bit) return ref;
+        // Lists above this one on the stack are taken by the same reduction, so their storage is free as well
+        const size_t index = ref & ~pending_bit;
+        pending_list_count_ = std::min(pending_list_count_, index);
+        const PendingList& list = pending_lists_[index];
+        return add_node(list.kind, list.elements.data(), list.elements.size());
+    }
+
+    uint32_t Parser::take_token(const size_t offset)
+    {
+        tree_.tokens.emplace_back(std::move(*(token_stack_.end() - offset - 1)));
+        return uint32_t(tree_.tokens.size() - 1) | Tree::token_bit;
+    }
+
+    uint32_t Parser::new_list(const NodeKind kind, const std::initializer_list<uint32_t> elements)
+    {
+        if (pending_list_count_ == pending_lists_.size()) pending_lists_.emplace_back();
+        PendingList& list = pending_lists_[pending_list_count_];
+        list.kind = kind;
+        list.elements.assign(elements);
+        return uint32_t(pending_list_count_++) | pending_bit;
+    }
+
+    uint32_t Parser::append(const uint32_t list, const uint32_t element)
+    {
+        pending_lists_[list & ~pending_bit].elements.push_back(element);
+        return list;
+    }
+
+    void Parser::replace(const size_t n, const size_t token_count, const uint32_t ref)
+    {
+        node_stack_.erase(node_stack_.end() - n, node_stack_.end());
+        node_stack_.push_back(ref);
+        token_stack_.erase(token_stack_.end() - token_count, token_stack_.end());
+        state_stack_.erase(state_stack_.end() - n, state_stack_.end());
+    }
+
+    Tree Parser::take_tree()
+    {
+        tree_.root = take(0);
+        return std::move(tree_);
     }
 
     )code";
@@ -325,7 +702,7 @@ namespace cls::lalr
                     [offset, this](const NonTerminal& t)
                     {
                         return fmt::format("{}<{}>({})",
-                            t.use_unique_ptr ? "make_unique_from_top" : "move_top",
+                            !t.use_unique_ptr ? "move_top" : options_.arena_ast ? "make_node_from_top" : "make_unique_from_top",
                             grammar_.non_terminals[t.index], offset);
                     }
                 }, term);
@@ -333,6 +710,11 @@ namespace cls::lalr
 
         void CodeGenerator::define_reduce()
         {
+            if (options_.flat_ast)
+            {
+                define_flat_reduce();
+                return;
+            }
             stream() << "void Parser::reduce(const size_t rule)";
             open_brace();
             stream() << "using namespace lex;"; new_line();
@@ -348,9 +730,29 @@ namespace cls::lalr
                     write("case {}:", index);
                     open_brace();
                     const size_t out_term_count = rule_saved_term_count_[i][j];
-                    if (out_term_count == 0) // No terms to output
+                    const auto& list = grammar_.lists[i];
+                    if (list && out_term_count != 0) // Append the element in place
+                    {
+                        const auto iter = std::find_if(rule.terms.begin() + (out_term_count == 2), rule.terms.end(),
+                            [this](const Term& t) { return !is_enum(t); });
+                        const std::string element = pop_term(*iter, rule.terms.end() - iter - 1);
+                        if (out_term_count == 2) // Grows the list below
+                        {
+                            write("std::get<{}>(*(node_stack_.end() - {})).{}.push_back({});",
+                                nt_name, rule.terms.size(), list->variable_name, element);
+                            new_line();
+                            write("pop_list_tail({}); go_to({}); return;", rule.terms.size(), i);
+                            close_brace(); new_line();
+                            index++;
+                            continue;
+                        }
+                        write("{} node;", nt_name); new_line();
+                        write("node.{}.push_back({});", list->variable_name, element); new_line();
+                        write("replace({}, std::move(node));", rule.terms.size());
+                    }
+                    else if (out_term_count == 0) // No terms to output
                     {
-                        write("node_stack_.emplace_back({}", nt_name);
+                        write("replace({}, {}", rule.terms.size(), nt_name);
                         if (!rule.type_name.empty()) write("{{ {}::{}", nt_name, rule.type_name);
                         write("{{}}{});", rule.type_name.empty() ? "" : " }");
                     }
@@ -358,12 +760,12 @@ namespace cls::lalr
                     {
                         const auto iter = std::find_if(rule.terms.begin(), rule.terms.end(),
                             [this](const Term& t) { return !is_enum(t); });
-                        write("node_stack_.emplace_back({}{{ {} }});",
-                            nt_name, pop_term(*iter, rule.terms.end() - iter - 1));
+                        write("replace({}, {}{{ {} }});",
+                            rule.terms.size(), nt_name, pop_term(*iter, rule.terms.end() - iter - 1));
                     }
                     else // Two or more terms to pop
                     {
-                        write("node_stack_.emplace_back({}", nt_name);
+                        write("replace({}, {}", rule.terms.size(), nt_name);
                         if (!rule.type_name.empty()) write("{{ {}::{}", nt_name, rule.type_name);
                         open_brace(false);
                         bool first = true;
@@ -378,38 +780,64 @@ namespace cls::lalr
                         close_brace(rule.type_name.empty() ? ");" : " });");
                     }
                     new_line();
-                    write("pop_n({}); break;", rule.terms.size());
+                    write("go_to({}); return;", i);
                     close_brace(); new_line();
                     index++;
                 }
             }
             stream() << "default: error();";
-            close_brace(); new_line();
-            stream() << "go_to();";
+            close_brace();
             close_brace();
             new_line(); new_line();
         }
 
-        void CodeGenerator::define_go_to()
+        void CodeGenerator::define_flat_reduce()
         {
-            stream() << "void Parser::go_to()";
+            stream() << "void Parser::reduce(const size_t rule)";
             open_brace();
-            stream() << "switch (state_stack_.back())";
+            stream() << "switch (rule)";
             open_brace();
-            for (const auto [i, row] : enumerate(table_))
+            size_t index = 1;
+            for (const auto [i, rules] : enumerate(grammar_.rules))
             {
-                if (std::all_of(row.go_to.begin(), row.go_to.end(),
-                    [](const size_t v) { return v == TableRow::no_goto; })) continue;
-                write("case {}: switch (current_node_type())", i);
-                open_brace();
-                for (const auto [j, v] : enumerate(row.go_to))
+                if (i == 0) continue;
+                const auto& list = grammar_.lists[i];
+                for (const auto [j, rule] : enumerate(rules))
                 {
-                    if (v == TableRow::no_goto) continue;
-                    write("case {}: state_stack_.emplace_back({}); return;", j - 1, v);
+                    // Take the saved terms in order, so that the children of a node are contiguous
+                    std::vector<std::string> children;
+                    size_t token_count = 0;
+                    for (size_t k = rule.terms.size(); k-- > 0;)
+                    {
+                        const Term& term = rule.terms[k];
+                        const bool is_terminal = std::holds_alternative<Terminal>(term);
+                        if (!is_enum(term))
+                            children.push_back(is_terminal ? fmt::format("take_token({})", token_count) :
+                                fmt::format("take({})", rule.terms.size() - 1 - k));
+                        token_count += is_terminal;
+                    }
+                    std::reverse(children.begin(), children.end());
+                    std::string node;
+                    if (list && !rule.terms.empty() && std::get_if<NonTerminal>(&rule.terms[0]) &&
+                        std::get<NonTerminal>(rule.terms[0]).is_list) // Grows the list below
+                        node = fmt::format("append(at({}), {})", rule.terms.size() - 1, children.back());
+                    else if (list)
+                        node = fmt::format("new_list(NodeKind::{}, {{{}}})", node_kind(i, j),
+                            children.empty() ? "" : fmt::format(" {} ", children[0]));
+                    else if (passes_through(i, j))
+                        node = children[0];
+                    else
+                    {
+                        std::string list_text;
+                        for (const std::string& child : children)
+                            list_text += (list_text.empty() ? " " : ", ") + child;
+                        node = fmt::format("add_node(NodeKind::{}, {{{}}})", node_kind(i, j),
+                            children.empty() ? "" : list_text + " ");
+                    }
+                    write("case {}: replace({}, {}, {}); go_to({}); return;",
+                        index++, rule.terms.size(), token_count, node, i);
                     new_line();
                 }
-                stream() << "default: error();";
-                close_brace(); new_line();
             }
             stream() << "default: error();";
             close_brace();
@@ -417,6 +845,44 @@ namespace cls::lalr
             new_line(); new_line();
         }
 
+        void CodeGenerator::define_go_to()
+        {
+            if (unit_chains_.size() == 1)
+            {
+                stream() << R"code(void Parser::go_to(const size_t non_terminal)
+    {
+        const size_t slot = goto_base[non_terminal] + state_stack_.back();
+        state_stack_.emplace_back(goto_check[slot] == non_terminal ? goto_value[slot] : goto_default[non_terminal]);
+    }
+
+    )code";
+                return;
+            }
+            stream() << R"code(void Parser::go_to(const size_t non_terminal)
+    {
+        const size_t slot = goto_base[non_terminal] + state_stack_.back();
+        const size_t target = goto_check[slot] == non_terminal ? goto_value[slot] : goto_default[non_terminal];)code";
+            indent_ = 8;
+            new_line();
+            write("switch (target / {}) // Unit reductions on the way", table_.size());
+            open_brace();
+            for (size_t i = 1; i < unit_chains_.size(); i++)
+            {
+                write("case {}: ", i);
+                for (const size_t rule : unit_chains_[i]) stream() << unit_reduction(rule);
+                stream() << "break;";
+                new_line();
+            }
+            stream() << "default: break;";
+            close_brace();
+            new_line();
+            write("state_stack_.emplace_back(target % {});", table_.size());
+            indent_ = 4;
+            new_line();
+            stream() << "}";
+            new_line(); new_line();
+        }
+
         std::vector<size_t> CodeGenerator::get_token_indices() const
         {
             std::vector<size_t> result(grammar_.token_types.size());
@@ -439,14 +905,18 @@ namespace cls::lalr
 
         void CodeGenerator::define_parse()
         {
+            if (options_.format == TableFormat::compressed)
+            {
+                define_compressed_parse();
+                return;
+            }
             const auto default_error = [this]()
             {
                 stream() << "default: error();";
                 close_brace(); new_line();
             };
             const std::vector<size_t> token_indices = get_token_indices();
-            const std::string& return_type = grammar_.non_terminals[1];
-            write("{} Parser::parse()", return_type);
+            write("{} Parser::parse()", parse_type());
             open_brace();
             stream() << "using namespace lex;"; new_line();
             stream() << "while (true)"; new_line(4);
@@ -454,6 +924,13 @@ namespace cls::lalr
             open_brace();
             for (const auto [i, row] : enumerate(table_))
             {
+                if (skipped_states_[i]) continue; // Left to the outer default
+                if (!options_.strict_errors && row.default_reduce != TableRow::no_default_reduce)
+                {
+                    write("case {}: reduce({}); continue;", i, row.default_reduce);
+                    new_line();
+                    continue;
+                }
                 write("case {}: switch (current_token_type())", i);
                 open_brace();
                 size_t prev_index = max_size;
@@ -483,7 +960,7 @@ namespace cls::lalr
                     {
                         case ActionType::shift: write("shift({}); continue;", action.index); break;
                         case ActionType::reduce: write("reduce({}); continue;", action.index); break;
-                        case ActionType::accept: write("return move_top<{}>();", return_type); break;
+                        case ActionType::accept: write("return {};", accept_expression()); break;
                         default: error("Unknown action type");
                     }
                     new_line();
@@ -497,15 +974,182 @@ namespace cls::lalr
             close_brace();
         }
 
+        void CodeGenerator::define_array(const std::string_view name, const std::vector<size_t>& values)
+        {
+            write("constexpr {} {}[]", unsigned_type(*std::max_element(values.begin(), values.end())), name);
+            open_brace();
+            for (const auto [i, value] : enumerate(values))
+            {
+                if (i != 0) stream() << (i % 16 == 0 ? "," : ", ");
+                if (i != 0 && i % 16 == 0) new_line();
+                stream() << value;
+            }
+            close_brace(";");
+        }
+
+        void CodeGenerator::define_tables()
+        {
+            // Actions are encoded as index << 2 | type, type is 0 for error, 1 for shift, 2 for reduce
+            // and 3 for accept, they are only emitted as arrays for the compressed format. Unless errors
+            // are strict, the most common reduction of a state is its default action, it may replace
+            // errors since the error is still detected before the next shift.
+            const auto encode = [](const Action& action) -> size_t
+            {
+                switch (action.type)
+                {
+                    case ActionType::shift: return action.index << 2 | 1;
+                    case ActionType::reduce: return action.index << 2 | 2;
+                    case ActionType::accept: return 3;
+                    default: return 0;
+                }
+            };
+            const size_t terminal_count = grammar_.token_types.size();
+            std::vector<size_t> action_default(table_.size(), 0);
+            std::vector<std::vector<std::pair<size_t, size_t>>> action_rows(table_.size());
+            for (const auto [i, row] : enumerate(table_))
+            {
+                if (skipped_states_[i]) continue; // An empty row defaulting to an error
+                std::unordered_map<size_t, size_t> counts;
+                size_t best_count = 0;
+                for (const Action& action : row.actions)
+                    if (!options_.strict_errors && action.type == ActionType::reduce && ++counts[action.index] > best_count)
+                    {
+                        best_count = counts[action.index];
+                        action_default[i] = encode(action);
+                    }
+                for (const auto [j, action] : enumerate(row.actions))
+                    if (action.type != ActionType::error ? encode(action) != action_default[i] :
+                        action_default[i] != 0 && contains(row.explicit_errors, j))
+                        action_rows[i].emplace_back(j, encode(action));
+            }
+            // One more column for tokens that the grammar does not know
+            const CombVector actions = compress_rows(action_rows, terminal_count + 1);
+
+            // Gotos are compressed by non-terminal in both formats, every reduction passes its non-terminal
+            // to go_to, so no switch on the node type is needed. The default is the most common target state,
+            // a target taking a unit shortcut is encoded as state + chain * state count, see define_go_to.
+            const auto encode_go_to = [this](const TableRow& row, const size_t nt)
+            {
+                if (row.go_to[nt] == TableRow::no_goto) return TableRow::no_goto;
+                const auto [target, chain] = go_to_target(row, nt);
+                return target + chain * table_.size();
+            };
+            std::vector<size_t> goto_default(grammar_.non_terminals.size(), 0);
+            std::vector<std::vector<std::pair<size_t, size_t>>> goto_rows(grammar_.non_terminals.size());
+            for (size_t nt = 0; nt < grammar_.non_terminals.size(); nt++)
+            {
+                std::unordered_map<size_t, size_t> counts;
+                size_t best_count = 0;
+                for (const TableRow& row : table_)
+                    if (const size_t target = encode_go_to(row, nt); target != TableRow::no_goto && ++counts[target] > best_count)
+                    {
+                        best_count = counts[target];
+                        goto_default[nt] = target;
+                    }
+                for (const auto [i, row] : enumerate(table_))
+                    if (const size_t target = encode_go_to(row, nt); target != TableRow::no_goto && target != goto_default[nt])
+                        goto_rows[nt].emplace_back(i, target);
+            }
+            const CombVector gotos = compress_rows(goto_rows, table_.size());
+
+            stream() << "namespace";
+            open_brace();
+            if (options_.format == TableFormat::compressed)
+            {
+                define_array("action_default", action_default); new_line();
+                define_array("action_base", actions.base); new_line();
+                define_array("action_value", actions.values); new_line();
+                define_array("action_check", actions.check); new_line();
+            }
+            // Kinds of the tokens that some rule saves in the tree
+            const std::vector<size_t> token_indices = get_token_indices();
+            std::vector<size_t> saved_kinds(token_indices.back() + 1, 0);
+            for (const std::vector<Rule>& rules : grammar_.rules)
+                for (const Rule& rule : rules)
+                    for (const Term& term : rule.terms)
+                        if (const Terminal* t = std::get_if<Terminal>(&term); t && !is_enum(term))
+                            saved_kinds[token_indices[t->index]] = 1;
+            define_array("saved_kinds", saved_kinds); new_line();
+            define_array("goto_default", goto_default); new_line();
+            define_array("goto_base", gotos.base); new_line();
+            define_array("goto_value", gotos.values); new_line();
+            define_array("goto_check", gotos.check);
+            close_brace();
+            stream() << '\n';
+        }
+
+        void CodeGenerator::define_current_terminal()
+        {
+            // Maps the lookahead to its column in the action table
+            const std::vector<size_t> token_indices = get_token_indices();
+            const size_t unknown = grammar_.token_types.size();
+            stream() << "size_t Parser::current_terminal()";
+            open_brace();
+            stream() << "using namespace lex;"; new_line();
+            stream() << "switch (current_token_type())";
+            open_brace();
+            for (size_t j = 0; j < grammar_.token_types.size();)
+            {
+                const TokenType& type = grammar_.token_types[j];
+                if (!type.enumerator)
+                {
+                    write("case {}: return {};", token_indices[j], j);
+                    new_line();
+                    j++;
+                    continue;
+                }
+                write("case {0}: switch (current_token<{0}>())", token_indices[j]);
+                open_brace();
+                const size_t index = token_indices[j];
+                for (; j < grammar_.token_types.size() && token_indices[j] == index; j++)
+                {
+                    write("case {}::{}: return {};", type.type_name, *grammar_.token_types[j].enumerator, j);
+                    new_line();
+                }
+                write("default: return {};", unknown);
+                close_brace(); new_line();
+            }
+            write("default: return {};", unknown);
+            close_brace();
+            close_brace();
+            new_line(); new_line();
+        }
+
+        void CodeGenerator::define_compressed_parse()
+        {
+            define_current_terminal();
+            write(R"code({0} Parser::parse()
+    {{
+        while (true)
+        {{
+            const size_t state = state_stack_.back();
+            const size_t slot = action_base[state] + current_terminal();
+            const size_t action = action_check[slot] == state ? action_value[slot] : action_default[state];
+            switch (action & 3)
+            {{
+                case 1: shift(action >> 2); break;
+                case 2: reduce(action >> 2); break;
+                case 3: return {1};
+                default: error();
+            }}
+        }}
+    }})code", parse_type(), accept_expression());
+        }
+
         CodeGenerator::CodeGenerator(const std::string& directory, const Grammar& grammar,
-            const std::vector<TableRow>& table) :
+            const std::vector<TableRow>& table, const CodeOptions& options) :
             header_stream_(directory + "parser.h"), source_stream_(directory + "parser.cpp"),
-            grammar_(grammar), table_(table)
+            grammar_(grammar), table_(table), options_(options)
         {
             if (header_stream_.fail()) error("Failed to open text file {}", directory);
             if (source_stream_.fail()) error("Failed to open text file {}", directory);
+            if (options_.flat_ast) options_.arena_ast = false; // No pointers to allocate
+            has_lists_ = std::any_of(grammar_.lists.begin(), grammar_.lists.end(),
+                [](const auto& list) { return list.has_value(); });
             for (const auto& rules : grammar_.rules)
             {
+                for (size_t j = 0; j < rules.size(); j++)
+                    rule_positions_.emplace_back(rule_saved_term_count_.size(), j);
                 auto& count = rule_saved_term_count_.emplace_back();
                 std::transform(rules.begin(), rules.end(), std::back_inserter(count),
                     [this](const Rule& rule)
@@ -514,18 +1158,37 @@ namespace cls::lalr
                         [this](const Term& term) { return !is_enum(term); });
                 });
             }
+            skipped_states_.resize(table_.size());
+            if (!options_.strict_errors)
+                for (const TableRow& row : table_)
+                    for (const UnitShortcut& shortcut : row.unit_shortcuts)
+                    {
+                        // Every go-to into a unit reduction state has a shortcut, the chains included
+                        skipped_states_[row.go_to[shortcut.non_terminal]] = true;
+                        if (std::vector<size_t> rules = unit_chain(shortcut);
+                            unit_chain_ids_.try_emplace(rules, unit_chains_.size()).second)
+                            unit_chains_.push_back(std::move(rules));
+                    }
         }
 
         void CodeGenerator::write_code()
         {
             stream() << R"(#pragma once
 
-#include <memory>
+#include <memory>)";
+            if (options_.flat_ast) stream() << "\n#include <cstdint>\n#include <initializer_list>";
+            stream() << R"(
 #include "lexer.h"
+#include "token_buffer.h")";
+            if (options_.arena_ast) stream() << "\n#include \"utils/arena.h\"";
+            stream() << R"(
 
 namespace cls::parse)"; // Write to header file
             open_brace();
-            define_structs();
+            if (options_.flat_ast)
+                define_flat_tree();
+            else
+                define_structs();
             declare_parser_class();
             close_brace();
             new_line();
@@ -534,9 +1197,12 @@ namespace cls::parse)"; // Write to header file
             stream() << R"(#include "parser.h"
 #include <stdexcept>
 #include <fmt/format.h>
+#include "line_index.h"
 
 namespace cls::parse)";
             open_brace(false);
+            new_line();
+            define_tables();
             define_parser_helpers();
             define_reduce();
             define_go_to();
@@ -547,8 +1213,8 @@ namespace cls::parse)";
     }
 
     void generate_code(const std::string& file_path, const Grammar& grammar,
-        const std::vector<TableRow>& table)
+        const std::vector<TableRow>& table, const CodeOptions& options)
     {
-        CodeGenerator(file_path, grammar, table).write_code();
+        CodeGenerator(file_path, grammar, table, options).write_code();
     }
 }
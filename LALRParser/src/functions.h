@@ -2,12 +2,22 @@
 
 #include <unordered_set>
 #include "types.h"
+#include "token_set.h"
 
 namespace cls::lalr
 {
-    Grammar process_input(const std::string& text);
-    std::vector<std::unordered_set<size_t>> compute_first_set(const Grammar& grammar);
-    std::vector<TableRow> generate_table(const Grammar& grammar);
-    void generate_code(const std::string& file_path, const Grammar& grammar,
-        const std::vector<TableRow>& table);
+    Grammar process_input(std::string_view text);
+    // The FIRST sets have an extra bit after the tokens standing for epsilon
+    std::vector<TokenSet> compute_first_set(const Grammar& grammar);
+    // The item sets are built on several threads unless the thread count is 1, 0 uses all hardware threads,
+    // the table is the same either way
+    std::vector<TableRow> generate_table(const Grammar& grammar,
+        LookaheadEngine engine = LookaheadEngine::merge, TableStats* stats = nullptr, size_t thread_count = 1);
+    // Generates the table with every engine and reports an error if the results differ,
+    // the statistics are those of the merge engine
+    std::vector<TableRow> generate_verified_table(const Grammar& grammar,
+        TableStats* stats = nullptr, size_t thread_count = 1);
+    void generate_code(const std::string& file_path, const Grammar& grammar, const std::vector<TableRow>& table,
+        const CodeOptions& options = {});
+    void generate_lexer(const std::string& file_path, const Grammar& grammar);
 }
@@ -18,11 +18,15 @@ namespace cls::lalr
             size_t non_terminal_index_ = max_size;
             std::string_view cut_prefix(size_t count);
             std::string_view next_symbol();
+            std::string read_delimited(char delimiter);
             void extract_non_terminals();
             size_t get_non_terminal_index(std::string_view name) const;
+            size_t read_token(std::string_view type_name);
             std::optional<Term> read_term();
             std::optional<std::pair<size_t, Rule>> read_rule();
             void process_token_type_list();
+            void process_precedences();
+            void process_lists();
         public:
             explicit GrammarParser(const std::string_view text) :left_text_(text) {}
             Grammar process();
@@ -50,6 +54,24 @@ namespace cls::lalr
             return cut_prefix(length);
         }
 
+        std::string GrammarParser::read_delimited(const char delimiter)
+        {
+            // The opening delimiter is already consumed by next_symbol
+            std::string result;
+            while (true)
+            {
+                if (left_text_.empty()) error("Missing closing delimiter '{}'", delimiter);
+                const char ch = cut_prefix(1)[0];
+                if (ch == delimiter) return result;
+                if (ch == '\\' && !left_text_.empty() && left_text_[0] == delimiter)
+                {
+                    result += cut_prefix(1)[0];
+                    continue;
+                }
+                result += ch;
+            }
+        }
+
         void GrammarParser::extract_non_terminals()
         {
             const std::string_view restore_point = left_text_;
@@ -72,6 +94,23 @@ namespace cls::lalr
             return size_t(iter - grammar_.non_terminals.begin());
         }
 
+        // Index of a terminal without variable name, e.g. Symbol.plus or $
+        size_t GrammarParser::read_token(const std::string_view type_name)
+        {
+            const auto iter = std::find_if(grammar_.token_types.begin(), grammar_.token_types.end(),
+                [type_name](const TokenType& type) { return type.type_name == type_name; });
+            if (iter == grammar_.token_types.end())
+                error("Failed to find corresponding term type \"{}\"", type_name);
+            if (!iter->enumerator) return size_t(iter - grammar_.token_types.begin());
+            if (next_symbol() != ".") error("Enum type name \"{}\" must be followed by an enumerator", type_name);
+            const std::string_view enumerator_name = next_symbol();
+            const auto enum_iter = std::find_if(iter, grammar_.token_types.end(),
+                [enumerator_name](const TokenType& type) { return type.enumerator == enumerator_name; });
+            if (enum_iter == grammar_.token_types.end())
+                error("Failed to find corresponding term type \"{}.{}\"", type_name, enumerator_name);
+            return size_t(enum_iter - grammar_.token_types.begin());
+        }
+
         std::optional<Term> GrammarParser::read_term()
         {
             const std::string_view type_name = next_symbol();
@@ -86,6 +125,14 @@ namespace cls::lalr
                     result.use_unique_ptr = true;
                     next = next_symbol();
                 }
+                else if (next == ".") // The list itself, X...(name)
+                {
+                    if (next_symbol() != "." || next_symbol() != ".")
+                        error("Expected \"...\" after non-terminal type name \"{}\"",
+                            grammar_.non_terminals[non_terminal]);
+                    result.is_list = true;
+                    next = next_symbol();
+                }
                 if (next != "(")
                     error("Non-terminal type name \"{}\" must be followed by parentheses "
                         "enclosed variable name", grammar_.non_terminals[non_terminal]);
@@ -144,8 +191,30 @@ namespace cls::lalr
             }
             else
                 left_text_ = restore_point;
-            while (auto term = read_term())
+            while (true)
+            {
+                const std::string_view term_start = left_text_;
+                if (next_symbol() == "%") // %prec Token; gives the alternative the precedence of the token
+                {
+                    if (next_symbol() != "prec") error("Only %prec may follow the terms of an alternative");
+                    const TokenType& type = grammar_.token_types[read_token(next_symbol())];
+                    if (type.precedence == 0) error("Token type \"{}\" after %prec has no precedence", type.type_name);
+                    rule.precedence = type.precedence;
+                    if (next_symbol() != ";") error("%prec must be the last part of an alternative");
+                    break;
+                }
+                left_text_ = term_start;
+                auto term = read_term();
+                if (!term) break;
+                if (const NonTerminal* nt = std::get_if<NonTerminal>(&*term);
+                    nt && nt->is_list && (nt->index != non_terminal_index_ || !rule.terms.empty()))
+                    error("\"{}...\" may only be the first term of an alternative of \"{}\"",
+                        grammar_.non_terminals[nt->index], grammar_.non_terminals[nt->index]);
+                if (const Terminal* t = std::get_if<Terminal>(&*term);
+                    t && grammar_.token_types[t->index].precedence != 0)
+                    rule.precedence = grammar_.token_types[t->index].precedence;
                 rule.terms.emplace_back(std::move(*term));
+            }
             return std::pair{ non_terminal_index_, rule };
         }
 
@@ -155,38 +224,142 @@ namespace cls::lalr
             {
                 const std::string symbol{ next_symbol() };
                 if (symbol == "$") break; // EOS symbol
-                const std::string_view next = next_symbol();
+                std::string_view next = next_symbol();
                 if (next == "{") // Enum type
                 {
                     while (true)
                     {
-                        grammar_.token_types.emplace_back(
+                        TokenType& type = grammar_.token_types.emplace_back(
                             TokenType{ symbol, std::string(next_symbol()) });
-                        const std::string_view separator = next_symbol();
+                        std::string_view separator = next_symbol();
+                        if (separator == "\"") // Spelling of the enumerator
+                        {
+                            type.literal = read_delimited('"');
+                            if (type.literal->empty())
+                                error("Spelling of \"{}.{}\" must not be empty", symbol, *type.enumerator);
+                            separator = next_symbol();
+                        }
                         if (separator == "}") break;
                         if (separator != ",") error("Enumerator list not finished");
                     }
                     if (next_symbol() != ",") error("Token type list not finished");
                     continue;
                 }
+                TokenType type{ symbol, {} };
+                if (next == "/") // Pattern of the token type
+                {
+                    type.pattern = read_delimited('/');
+                    next = next_symbol();
+                }
                 if (next != "," || symbol.empty()) error("Token type list not finished");
-                grammar_.token_types.emplace_back(TokenType{ symbol, {} });
+                grammar_.token_types.emplace_back(std::move(type));
             }
             grammar_.token_types.emplace_back(TokenType{ "$", {} });
         }
 
+        void GrammarParser::process_precedences()
+        {
+            // %left Symbol.plus Symbol.minus; lines after the token types, from the loosest to the tightest
+            size_t precedence = 0;
+            while (true)
+            {
+                const std::string_view restore_point = left_text_;
+                if (next_symbol() != "%")
+                {
+                    left_text_ = restore_point;
+                    return;
+                }
+                const std::string_view kind = next_symbol();
+                Associativity associativity;
+                if (kind == "left") associativity = Associativity::left;
+                else if (kind == "right") associativity = Associativity::right;
+                else if (kind == "nonassoc") associativity = Associativity::nonassoc;
+                else error("Unknown precedence declaration \"%{}\"", kind);
+                precedence++;
+                while (true)
+                {
+                    const std::string_view type_name = next_symbol();
+                    if (type_name == ";") break;
+                    if (type_name.empty()) error("Precedence declaration not finished");
+                    TokenType& type = grammar_.token_types[read_token(type_name)];
+                    if (type.precedence != 0)
+                        error("Precedence of token type \"{}{}{}\" is declared twice", type.type_name,
+                            type.enumerator ? "." : "", type.enumerator.value_or(""));
+                    type.precedence = precedence;
+                    type.associativity = associativity;
+                }
+            }
+        }
+
+        void GrammarParser::process_lists()
+        {
+            const auto is_recursive = [](const Rule& rule)
+            {
+                if (rule.terms.empty()) return false;
+                const NonTerminal* nt = std::get_if<NonTerminal>(&rule.terms[0]);
+                return nt && nt->is_list;
+            };
+            const auto same_type = [](const Term& lhs, const Term& rhs)
+            {
+                if (lhs.index() != rhs.index()) return false;
+                if (const NonTerminal* nt = std::get_if<NonTerminal>(&lhs))
+                {
+                    const NonTerminal& other = std::get<NonTerminal>(rhs);
+                    return nt->index == other.index && nt->use_unique_ptr == other.use_unique_ptr;
+                }
+                return std::get<Terminal>(lhs).index == std::get<Terminal>(rhs).index;
+            };
+            grammar_.lists.resize(grammar_.non_terminals.size());
+            for (const auto [i, rules] : enumerate(grammar_.rules))
+            {
+                if (std::none_of(rules.begin(), rules.end(), is_recursive)) continue;
+                const std::string& name = grammar_.non_terminals[i];
+                std::string variable_name;
+                std::optional<Term> element;
+                for (const Rule& rule : rules)
+                {
+                    if (!rule.type_name.empty()) error("Alternatives of list \"{}\" must not be named", name);
+                    const bool recursive = is_recursive(rule);
+                    if (recursive)
+                    {
+                        const std::string& list_name = std::get<NonTerminal>(rule.terms[0]).variable_name;
+                        if (variable_name.empty()) variable_name = list_name;
+                        else if (variable_name != list_name)
+                            error("Alternatives of list \"{}\" name it both \"{}\" and \"{}\"",
+                                name, variable_name, list_name);
+                    }
+                    size_t count = 0;
+                    for (auto iter = rule.terms.begin() + recursive; iter != rule.terms.end(); ++iter)
+                    {
+                        if (const Terminal* t = std::get_if<Terminal>(&*iter);
+                            t && grammar_.token_types[t->index].enumerator) continue;
+                        count++;
+                        if (!element) element = *iter;
+                        else if (!same_type(*element, *iter))
+                            error("Elements of list \"{}\" must be of the same type", name);
+                    }
+                    if (count > 1 || (recursive && count == 0))
+                        error("Alternatives of list \"{}\" must hold one element each, "
+                            "only those not starting with \"{}...\" may hold none", name, name);
+                }
+                grammar_.lists[i] = ListInfo{ std::move(variable_name), std::move(*element) };
+            }
+        }
+
         Grammar GrammarParser::process()
         {
             process_token_type_list();
+            process_precedences();
             grammar_.non_terminals.emplace_back();
             extract_non_terminals();
             grammar_.rules.resize(grammar_.non_terminals.size());
             grammar_.rules[0].emplace_back(Rule{ "", { NonTerminal{ 1, false } } });
             while (auto rule_info = read_rule())
                 grammar_.rules[rule_info->first].emplace_back(std::move(rule_info->second));
+            process_lists();
             return std::move(grammar_);
         }
     }
 
-    Grammar process_input(const std::string& text) { return GrammarParser(text).process(); }
+    Grammar process_input(const std::string_view text) { return GrammarParser(text).process(); }
 }
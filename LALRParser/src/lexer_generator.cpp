@@ -0,0 +1,569 @@
+#include "functions.h"
+#include <array>
+#include <bitset>
+#include <map>
+#include <fstream>
+#include <utility>
+#include "utils.h"
+
+namespace cls::lalr
+{
+    using namespace utils;
+
+    namespace
+    {
+        using ByteSet = std::bitset<256>;
+        using DfaRow = std::array<size_t, 256>;
+        constexpr size_t unknown_reads = max_size - 1; // Not computed yet, see lookahead_from
+
+        struct NfaState final
+        {
+            std::vector<std::pair<ByteSet, size_t>> transitions;
+            std::vector<size_t> epsilon;
+            size_t accept = max_size; // Index of the accepted token type
+        };
+
+        class LexerGenerator final
+        {
+        private:
+            static constexpr size_t dead_state = 0;
+            static constexpr size_t start_state = 1;
+            std::ofstream stream_;
+            const Grammar& grammar_;
+            std::vector<NfaState> nfa_;
+            std::vector<DfaRow> dfa_;
+            std::vector<size_t> accepts_; // Accepted token type of each DFA state
+            std::vector<size_t> reserved_words_; // Literal token types that are also matched by a pattern
+            std::vector<std::string> reserved_kinds_; // Kinds of the patterns matching those
+            template <typename... Ts>
+            void write(Ts&& ... vs)
+            {
+                fmt::format_to(std::ostreambuf_iterator(stream_), std::forward<Ts>(vs)...);
+            }
+            size_t new_nfa_state();
+            static char read_escaped(std::string_view& pattern);
+            static ByteSet read_class(std::string_view& pattern);
+            void add_literal(size_t token, std::string_view literal);
+            void add_pattern(size_t token, std::string_view pattern);
+            void build_nfa();
+            void epsilon_closure(std::vector<size_t>& states) const;
+            size_t matching_pattern(std::string_view literal) const;
+            void build_dfa();
+            void minimize_dfa();
+            size_t lookahead_from(size_t state, std::vector<size_t>& reads, std::vector<Bool>& on_path) const;
+            size_t max_lookahead() const;
+            std::vector<std::string> get_kinds() const;
+            static std::string escape(std::string_view text);
+            std::vector<std::string> write_self_loops();
+            void write_reserved_words(const std::vector<std::string>& kinds);
+            void write_table();
+        public:
+            LexerGenerator(const std::string& directory, const Grammar& grammar);
+            void generate();
+        };
+
+        size_t LexerGenerator::new_nfa_state()
+        {
+            nfa_.emplace_back();
+            return nfa_.size() - 1;
+        }
+
+        char LexerGenerator::read_escaped(std::string_view& pattern)
+        {
+            if (pattern.empty()) error("Unexpected end of token pattern");
+            char ch = pattern[0];
+            pattern.remove_prefix(1);
+            if (ch != '\\') return ch;
+            if (pattern.empty()) error("Unexpected end of token pattern after '\\'");
+            ch = pattern[0];
+            pattern.remove_prefix(1);
+            switch (ch)
+            {
+                case 'n': return '\n';
+                case 'r': return '\r';
+                case 't': return '\t';
+                default: return ch;
+            }
+        }
+
+        ByteSet LexerGenerator::read_class(std::string_view& pattern)
+        {
+            // The opening bracket is already consumed
+            ByteSet result;
+            const bool negate = !pattern.empty() && pattern[0] == '^';
+            if (negate) pattern.remove_prefix(1);
+            while (true)
+            {
+                if (pattern.empty()) error("Character class in token pattern is not closed");
+                if (pattern[0] == ']')
+                {
+                    pattern.remove_prefix(1);
+                    break;
+                }
+                const auto first = uint8_t(read_escaped(pattern));
+                auto last = first;
+                if (pattern.size() >= 2 && pattern[0] == '-' && pattern[1] != ']') // Range
+                {
+                    pattern.remove_prefix(1);
+                    last = uint8_t(read_escaped(pattern));
+                    if (last < first) error("Invalid character range in token pattern");
+                }
+                for (size_t ch = first; ch <= last; ch++) result.set(ch);
+            }
+            return negate ? ~result : result;
+        }
+
+        void LexerGenerator::add_literal(const size_t token, const std::string_view literal)
+        {
+            size_t current = new_nfa_state();
+            nfa_[0].epsilon.emplace_back(current);
+            for (const char ch : literal)
+            {
+                const size_t next = new_nfa_state();
+                nfa_[current].transitions.emplace_back(ByteSet().set(uint8_t(ch)), next);
+                current = next;
+            }
+            nfa_[current].accept = token;
+        }
+
+        void LexerGenerator::add_pattern(const size_t token, std::string_view pattern)
+        {
+            // Supports a sequence of single characters or character classes,
+            // each of which may be followed by a quantifier *, + or ?
+            size_t current = new_nfa_state();
+            nfa_[0].epsilon.emplace_back(current);
+            while (!pattern.empty())
+            {
+                ByteSet set;
+                if (pattern[0] == '[')
+                {
+                    pattern.remove_prefix(1);
+                    set = read_class(pattern);
+                }
+                else
+                    set.set(uint8_t(read_escaped(pattern)));
+                const char quantifier = pattern.empty() ? '\0' : pattern[0];
+                const size_t next = new_nfa_state();
+                switch (quantifier)
+                {
+                    case '*': // current -e-> next -set-> next
+                        nfa_[current].epsilon.emplace_back(next);
+                        nfa_[next].transitions.emplace_back(set, next);
+                        break;
+                    case '+': // current -set-> next -set-> next
+                        nfa_[current].transitions.emplace_back(set, next);
+                        nfa_[next].transitions.emplace_back(set, next);
+                        break;
+                    case '?': // current -set/e-> next
+                        nfa_[current].transitions.emplace_back(set, next);
+                        nfa_[current].epsilon.emplace_back(next);
+                        break;
+                    default:
+                        nfa_[current].transitions.emplace_back(set, next);
+                        break;
+                }
+                if (quantifier == '*' || quantifier == '+' || quantifier == '?') pattern.remove_prefix(1);
+                current = next;
+            }
+            nfa_[current].accept = token;
+        }
+
+        void LexerGenerator::build_nfa()
+        {
+            new_nfa_state(); // Start state
+            for (const auto [i, type] : enumerate(grammar_.token_types))
+                if (type.pattern)
+                    add_pattern(i, *type.pattern);
+            // Literals like keywords that a pattern also matches are left out of the DFA,
+            // they are looked up in a perfect hash table after the pattern is matched
+            for (const auto [i, type] : enumerate(grammar_.token_types))
+                if (type.literal)
+                {
+                    if (const size_t pattern = matching_pattern(*type.literal); pattern != max_size)
+                    {
+                        reserved_words_.emplace_back(i);
+                        if (const std::string& kind = grammar_.token_types[pattern].type_name; !contains(reserved_kinds_, kind))
+                            reserved_kinds_.emplace_back(kind);
+                    }
+                    else
+                        add_literal(i, *type.literal);
+                }
+        }
+
+        void LexerGenerator::epsilon_closure(std::vector<size_t>& states) const
+        {
+            for (size_t i = 0; i < states.size(); i++)
+                for (const size_t next : nfa_[states[i]].epsilon)
+                    if (!contains(states, next))
+                        states.emplace_back(next);
+            std::sort(states.begin(), states.end());
+        }
+
+        size_t LexerGenerator::matching_pattern(const std::string_view literal) const
+        {
+            // The pattern token type the DFA accepts the literal as, max_size if none
+            std::vector<size_t> states{ 0 };
+            epsilon_closure(states);
+            for (const char ch : literal)
+            {
+                std::vector<size_t> next;
+                for (const size_t state : states)
+                    for (const auto& [set, dest] : nfa_[state].transitions)
+                        if (set.test(uint8_t(ch)) && !contains(next, dest))
+                            next.emplace_back(dest);
+                epsilon_closure(next);
+                states = std::move(next);
+            }
+            size_t result = max_size;
+            for (const size_t state : states) // Earlier declared token types take priority
+                result = std::min(result, nfa_[state].accept);
+            return result;
+        }
+
+        void LexerGenerator::build_dfa()
+        {
+            // Subset construction, DFA state 0 is the dead state (empty set of NFA states)
+            std::vector<std::vector<size_t>> subsets(2);
+            subsets[start_state].emplace_back(0);
+            epsilon_closure(subsets[start_state]);
+            std::map<std::vector<size_t>, size_t> indices{ { subsets[0], 0 }, { subsets[1], 1 } };
+            for (size_t i = 0; i < subsets.size(); i++)
+            {
+                DfaRow row{};
+                for (size_t ch = 0; ch < 256; ch++)
+                {
+                    std::vector<size_t> next;
+                    for (const size_t state : subsets[i])
+                        for (const auto& [set, dest] : nfa_[state].transitions)
+                            if (set.test(ch) && !contains(next, dest))
+                                next.emplace_back(dest);
+                    epsilon_closure(next);
+                    const auto [iter, inserted] = indices.try_emplace(next, subsets.size());
+                    if (inserted) subsets.emplace_back(std::move(next));
+                    row[ch] = iter->second;
+                }
+                dfa_.emplace_back(row);
+                size_t& accept = accepts_.emplace_back(max_size);
+                for (const size_t state : subsets[i]) // Earlier declared token types take priority
+                    accept = std::min(accept, nfa_[state].accept);
+            }
+        }
+
+        void LexerGenerator::minimize_dfa()
+        {
+            // Moore's partition refinement, starting from partitioning by the accepted token type
+            const size_t size = dfa_.size();
+            std::vector<size_t> block(size);
+            size_t block_count = 0;
+            {
+                std::map<size_t, size_t> initial;
+                for (size_t i = 0; i < size; i++)
+                    block[i] = initial.try_emplace(accepts_[i], initial.size()).first->second;
+                block_count = initial.size();
+            }
+            while (true)
+            {
+                std::map<std::vector<size_t>, size_t> signatures;
+                std::vector<size_t> new_block(size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    std::vector<size_t> signature{ block[i] };
+                    signature.reserve(257);
+                    for (const size_t dest : dfa_[i]) signature.emplace_back(block[dest]);
+                    new_block[i] = signatures.try_emplace(std::move(signature), signatures.size()).first->second;
+                }
+                block = std::move(new_block);
+                if (signatures.size() == block_count) break;
+                block_count = signatures.size();
+            }
+            // Renumber the blocks in BFS order from the start state, keeping the dead state at 0
+            std::vector<size_t> renumber(block_count, max_size);
+            std::vector<size_t> representatives;
+            const auto visit = [&](const size_t state)
+            {
+                if (renumber[block[state]] != max_size) return;
+                renumber[block[state]] = representatives.size();
+                representatives.emplace_back(state);
+            };
+            visit(dead_state);
+            visit(start_state);
+            for (size_t i = 0; i < representatives.size(); i++)
+                for (const size_t dest : dfa_[representatives[i]])
+                    visit(dest);
+            std::vector<DfaRow> minimized;
+            std::vector<size_t> accepts;
+            for (const size_t state : representatives)
+            {
+                DfaRow& row = minimized.emplace_back();
+                for (size_t ch = 0; ch < 256; ch++) row[ch] = renumber[block[dfa_[state][ch]]];
+                accepts.emplace_back(accepts_[state]);
+            }
+            dfa_ = std::move(minimized);
+            accepts_ = std::move(accepts);
+        }
+
+        size_t LexerGenerator::lookahead_from(const size_t state,
+            std::vector<size_t>& reads, std::vector<Bool>& on_path) const
+        {
+            // Characters read from the state until the DFA dies or accepts again, max_size if unbounded
+            if (reads[state] != unknown_reads) return reads[state];
+            on_path[state] = true;
+            size_t result = 0;
+            for (const size_t dest : dfa_[state])
+            {
+                size_t count = 0;
+                if (dest == dead_state) count = 1;
+                else if (accepts_[dest] != max_size) count = 0; // The match grows, later reads count from there
+                else if (on_path[dest]) count = max_size; // Loops without accepting
+                else if (const size_t rest = lookahead_from(dest, reads, on_path); rest != max_size) count = rest + 1;
+                else count = max_size;
+                result = std::max(result, count);
+            }
+            on_path[state] = false;
+            return reads[state] = result;
+        }
+
+        size_t LexerGenerator::max_lookahead() const
+        {
+            // The DFA keeps reading after a match until it dies, a match may end at the start state
+            // (an empty match) or at any accepting state
+            std::vector<size_t> reads(dfa_.size(), unknown_reads);
+            std::vector<Bool> on_path(dfa_.size());
+            size_t result = lookahead_from(start_state, reads, on_path);
+            for (size_t i = 0; i < dfa_.size(); i++)
+                if (accepts_[i] != max_size)
+                    result = std::max(result, lookahead_from(i, reads, on_path));
+            return result;
+        }
+
+        std::vector<std::string> LexerGenerator::get_kinds() const
+        {
+            std::vector<std::string> kinds;
+            for (const TokenType& type : grammar_.token_types)
+                if ((type.literal || type.pattern) && !contains(kinds, type.type_name))
+                    kinds.emplace_back(type.type_name);
+            return kinds;
+        }
+
+        std::string LexerGenerator::escape(const std::string_view text)
+        {
+            // Contents of a C++ string literal spelling the text
+            std::string result;
+            for (const char ch : text)
+            {
+                if (ch == '"' || ch == '\\') result += '\\';
+                if (ch >= ' ' && ch <= '~') result += ch;
+                else result += fmt::format("\\{:03o}", uint8_t(ch)); // Octal escapes take at most 3 digits
+            }
+            return result;
+        }
+
+        std::vector<std::string> LexerGenerator::write_self_loops()
+        {
+            // Character classes that a state transitions to itself on, the driver skips runs of
+            // those with vectorized scanning, e.g. the rest of an identifier or an integer
+            constexpr size_t max_ranges = 8; // utils::CharRanges::max_ranges
+            std::vector<std::string> loop_sets;
+            std::vector<size_t> self_loops(dfa_.size(), max_size);
+            for (const auto [i, row] : enumerate(std::as_const(dfa_)))
+            {
+                if (i == dead_state) continue;
+                std::string ranges;
+                size_t count = 0;
+                for (size_t ch = 0; ch < 256; ch++)
+                {
+                    if (row[ch] != i || (ch != 0 && row[ch - 1] == i)) continue; // Not the start of a range
+                    size_t last = ch;
+                    while (last + 1 < 256 && row[last + 1] == i) last++;
+                    ranges += fmt::format("{}{{ {}, {} }}", count == 0 ? "" : ", ", ch, last);
+                    count++;
+                }
+                if (count == 0 || count > max_ranges) continue;
+                auto iter = std::find(loop_sets.begin(), loop_sets.end(), ranges);
+                if (iter == loop_sets.end()) iter = loop_sets.insert(iter, std::move(ranges));
+                self_loops[i] = size_t(iter - loop_sets.begin());
+            }
+            if (loop_sets.empty()) return loop_sets;
+            if (loop_sets.size() >= 255) error("Lexer DFA contains too many self looping states");
+            write(R"(
+    // Character classes that states loop on, runs of them are skipped with vectorized scanning
+    constexpr uint8_t no_loop = 255;
+    constexpr utils::CharRanges loop_sets[]
+    {{)");
+            for (const std::string& ranges : loop_sets)
+                write("\n        utils::CharRanges({{ {} }}),", ranges);
+            write(R"(
+    }};
+
+    constexpr uint8_t self_loops[]
+    {{)");
+            for (const auto [i, loop] : enumerate(self_loops))
+            {
+                write(i % 16 == 0 ? "\n        " : " ");
+                if (loop == max_size) write("no_loop,");
+                else write("{},", loop);
+            }
+            write(R"(
+    }};
+)");
+            return loop_sets;
+        }
+
+        void LexerGenerator::write_table()
+        {
+            if (dfa_.size() > 65536) error("Lexer DFA contains too many states");
+            const std::string_view state_type = dfa_.size() <= 256 ? "uint8_t" : "uint16_t";
+            write(R"(#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include "lexer.h"
+#include "utils/char_ranges.h"
+#include "utils/perfect_hash.h"
+
+namespace cls::lex::dfa
+{{
+    enum class Kind : uint8_t {{ none)");
+            const std::vector<std::string> kinds = get_kinds();
+            for (const std::string& kind : kinds) write(", {}", kind);
+            write(R"( }};
+
+    struct Accept final
+    {{
+        Kind kind = Kind::none;
+        uint8_t value = 0; // Enumerator value of enum token types
+    }};
+
+    struct Match final
+    {{
+        size_t length = 0;
+        Accept accept;
+    }};
+
+    using State = {};
+    constexpr State dead_state = {};
+    constexpr State start_state = {};
+
+    constexpr State transitions[][256]
+    {{)", state_type, dead_state, start_state);
+            for (const DfaRow& row : dfa_)
+            {
+                write("\n        {{");
+                for (size_t ch = 0; ch < 256; ch++)
+                {
+                    if (ch % 32 == 0) write("\n            ");
+                    write("{},", row[ch]);
+                }
+                write("\n        }},");
+            }
+            write(R"(
+    }};
+
+    constexpr Accept accepts[]
+    {{)");
+            for (const size_t accept : accepts_)
+            {
+                if (accept == max_size)
+                {
+                    write("\n        {{}},");
+                    continue;
+                }
+                const TokenType& type = grammar_.token_types[accept];
+                if (type.enumerator)
+                    write("\n        {{ Kind::{0}, uint8_t({0}::{1}) }},", type.type_name, *type.enumerator);
+                else
+                    write("\n        {{ Kind::{} }},", type.type_name);
+            }
+            write(R"(
+    }};
+)");
+            const std::vector<std::string> loop_sets = write_self_loops();
+            write_reserved_words(kinds);
+            const size_t lookahead = max_lookahead();
+            write(R"(
+    // Characters the DFA may read past the end of a match, the one it stops at included,
+    // SIZE_MAX if unbounded. Tokens that may have read an edited character are relexed.
+    constexpr size_t max_lookahead = {};
+)", lookahead == max_size ? "SIZE_MAX" : std::to_string(lookahead));
+            write(R"(
+    // Longest match at the beginning of the text, costs one table lookup per byte
+    inline Match longest_match(const std::string_view text)
+    {{
+        Match match;
+        State state = start_state;
+        for (size_t i = 0; i < text.size(); i++)
+        {{
+            state = transitions[state][uint8_t(text[i])];
+            if (state == dead_state) break;{}
+            if (accepts[state].kind != Kind::none) match = {{ i + 1, accepts[state] }};
+        }}
+        return match;
+    }}
+}}
+)", loop_sets.empty() ? "" : R"(
+            if (self_loops[state] != no_loop) // Skip the rest of the run at once
+            {
+                const char* run_end = loop_sets[self_loops[state]].skip(text.data() + i + 1, text.data() + text.size());
+                i = size_t(run_end - text.data()) - 1;
+            })");
+        }
+
+        void LexerGenerator::write_reserved_words(const std::vector<std::string>& kinds)
+        {
+            write(R"(
+    // Whether a match of the kind may be a reserved word, so that it is looked up in the table below
+    constexpr bool may_be_reserved[]
+    {{
+        false,)");
+            for (const std::string& kind : kinds)
+                write(" {},", contains(reserved_kinds_, kind) ? "true" : "false");
+            write("\n    }};\n");
+            if (reserved_words_.empty())
+            {
+                write(R"(
+    constexpr utils::PerfectHashMap<Accept, 0> reserved_words{{}};
+)");
+                return;
+            }
+            write(R"(
+    // Literal token types that a pattern token type also matches, e.g. keywords as identifiers
+    constexpr std::pair<std::string_view, Accept> reserved_word_list[]
+    {{)");
+            for (const size_t token : reserved_words_)
+            {
+                const TokenType& type = grammar_.token_types[token];
+                write("\n        {{ \"{}\", ", escape(*type.literal));
+                if (type.enumerator)
+                    write("{{ Kind::{0}, uint8_t({0}::{1}) }} }},", type.type_name, *type.enumerator);
+                else
+                    write("{{ Kind::{} }} }},", type.type_name);
+            }
+            write(R"(
+    }};
+
+    // Resolved with one hash and one compare however many reserved words there are
+    constexpr utils::PerfectHashMap reserved_words(reserved_word_list);
+)");
+        }
+
+        LexerGenerator::LexerGenerator(const std::string& directory, const Grammar& grammar) :
+            stream_(directory + "lex_table.h"), grammar_(grammar)
+        {
+            if (stream_.fail()) error("Failed to open text file {}", directory);
+        }
+
+        void LexerGenerator::generate()
+        {
+            build_nfa();
+            build_dfa();
+            minimize_dfa();
+            write_table();
+        }
+    }
+
+    void generate_lexer(const std::string& file_path, const Grammar& grammar)
+    {
+        LexerGenerator(file_path, grammar).generate();
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <stdexcept>
+#include <utility>
+
+namespace cls::utils
+{
+    namespace detail
+    {
+        constexpr size_t bit_ceil(const size_t value)
+        {
+            size_t result = 1;
+            while (result < value) result <<= 1;
+            return result;
+        }
+
+        // 64-bit FNV-1a
+        constexpr uint64_t fnv1a(const std::string_view text)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (const char ch : text)
+            {
+                hash ^= uint8_t(ch);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+    }
+
+    // A string keyed map whose perfect hash function is found at compile time.
+    // Keys are distributed into buckets by the lower bits of the hash, and each bucket
+    // has a displacement chosen such that the slots of its keys never collide.
+    // A lookup hashes the key once and compares against at most one stored key.
+    template <typename T, size_t N>
+    class PerfectHashMap final
+    {
+    private:
+        static constexpr size_t bucket_count = detail::bit_ceil(N);
+        static constexpr size_t slot_count = bucket_count * 2;
+        std::array<uint32_t, bucket_count> displacements_{};
+        std::array<std::string_view, slot_count> keys_{};
+        std::array<T, slot_count> values_{};
+        std::array<bool, slot_count> occupied_{};
+
+        static constexpr size_t bucket_of(const uint64_t hash) { return uint32_t(hash) & (bucket_count - 1); }
+        static constexpr size_t slot_of(uint64_t hash, const uint32_t displacement)
+        {
+            // Remix the hash so that the slot does not depend on the bits choosing the bucket
+            hash ^= hash >> 31;
+            hash *= 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 29;
+            const uint32_t low = uint32_t(hash);
+            const uint32_t high = uint32_t(hash >> 32) | 1; // Odd, so that displacements cover all slots
+            return (low + displacement * high) & (slot_count - 1);
+        }
+
+    public:
+        constexpr explicit PerfectHashMap(const std::pair<std::string_view, T>(&entries)[N])
+        {
+            // Group the entries by bucket
+            std::array<uint64_t, N> hashes{};
+            std::array<size_t, bucket_count + 1> bucket_begin{};
+            for (size_t i = 0; i < N; i++)
+            {
+                hashes[i] = detail::fnv1a(entries[i].first);
+                bucket_begin[bucket_of(hashes[i]) + 1]++;
+            }
+            size_t max_bucket_size = 0;
+            for (size_t i = 0; i < bucket_count; i++)
+            {
+                max_bucket_size = std::max(max_bucket_size, bucket_begin[i + 1]);
+                bucket_begin[i + 1] += bucket_begin[i];
+            }
+            std::array<size_t, N> grouped{};
+            std::array<size_t, bucket_count> filled{};
+            for (size_t i = 0; i < N; i++)
+            {
+                const size_t bucket = bucket_of(hashes[i]);
+                grouped[bucket_begin[bucket] + filled[bucket]++] = i;
+            }
+            // Place the buckets with more keys first, those are harder to fit
+            for (size_t size = max_bucket_size; size > 0; size--)
+                for (size_t bucket = 0; bucket < bucket_count; bucket++)
+                {
+                    const size_t begin = bucket_begin[bucket], end = bucket_begin[bucket + 1];
+                    if (end - begin != size) continue;
+                    for (uint32_t displacement = 0;; displacement++)
+                    {
+                        if (displacement == slot_count * 4)
+                            throw std::logic_error("Failed to find a perfect hash function");
+                        bool fits = true;
+                        for (size_t i = begin; i < end && fits; i++)
+                        {
+                            const size_t slot = slot_of(hashes[grouped[i]], displacement);
+                            fits = !occupied_[slot];
+                            for (size_t j = begin; j < i && fits; j++) // Collision inside the bucket
+                                fits = slot != slot_of(hashes[grouped[j]], displacement);
+                        }
+                        if (!fits) continue;
+                        displacements_[bucket] = displacement;
+                        for (size_t i = begin; i < end; i++)
+                        {
+                            const size_t slot = slot_of(hashes[grouped[i]], displacement);
+                            occupied_[slot] = true;
+                            keys_[slot] = entries[grouped[i]].first;
+                            values_[slot] = entries[grouped[i]].second;
+                        }
+                        break;
+                    }
+                }
+        }
+
+        constexpr const T* find(const std::string_view key) const
+        {
+            const uint64_t hash = detail::fnv1a(key);
+            const size_t slot = slot_of(hash, displacements_[bucket_of(hash)]);
+            return occupied_[slot] && keys_[slot] == key ? &values_[slot] : nullptr;
+        }
+    };
+
+    // An empty map, a zero sized array of entries cannot be declared
+    template <typename T>
+    class PerfectHashMap<T, 0> final
+    {
+    public:
+        constexpr PerfectHashMap() = default;
+        constexpr const T* find(std::string_view) const { return nullptr; }
+    };
+
+    template <typename T, size_t N>
+    PerfectHashMap(const std::pair<std::string_view, T>(&)[N])->PerfectHashMap<T, N>;
+}
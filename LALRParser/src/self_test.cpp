@@ -0,0 +1,134 @@
+#include "self_test.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include "functions.h"
+#include "utils.h"
+
+namespace cls::lalr
+{
+    using namespace utils;
+
+    namespace
+    {
+        // Every kind of declaration is used: the comma is left associative, the assignment right
+        // associative, the range non-associative, and negation takes the precedence of * by %prec
+        constexpr std::string_view precedence_grammar = R"(Symbol
+{
+    comma ",", equal "=", colon ":",
+    plus "+", minus "-", star "*"
+},
+Integer /[0-9]+/,
+LexError, $
+
+%left Symbol.comma;
+%right Symbol.equal;
+%nonassoc Symbol.colon;
+%left Symbol.plus Symbol.minus;
+%left Symbol.star;
+
+Expr: [Comma] Expr*(lhs) Symbol.comma Expr*(rhs);
+    | [Assign] Expr*(lhs) Symbol.equal Expr*(rhs);
+    | [Range] Expr*(lhs) Symbol.colon Expr*(rhs);
+    | [Add] Expr*(lhs) Symbol.plus Expr*(rhs);
+    | [Sub] Expr*(lhs) Symbol.minus Expr*(rhs);
+    | [Mul] Expr*(lhs) Symbol.star Expr*(rhs);
+    | [Neg] Symbol.minus Expr*(operand) %prec Symbol.star;
+    | [Int] Integer(value);
+)";
+
+        // The action on the lookahead in the states that reduce the alternative on some token
+        struct Expectation final
+        {
+            std::string_view alternative;
+            std::string_view lookahead; // Enumerator of Symbol
+            ActionType action = ActionType::error;
+        };
+
+        constexpr Expectation expectations[]
+        {
+            { "Comma", "comma", ActionType::reduce }, // 1,2,3 is (1,2),3
+            { "Assign", "equal", ActionType::shift }, // 1=2=3 is 1=(2=3)
+            { "Range", "colon", ActionType::error }, // 1:2:3 is an error
+            { "Add", "minus", ActionType::reduce }, // Same level, left associative
+            { "Sub", "plus", ActionType::reduce },
+            { "Add", "star", ActionType::shift }, // 1+2*3 is 1+(2*3)
+            { "Mul", "plus", ActionType::reduce }, // 1*2+3 is (1*2)+3
+            { "Comma", "equal", ActionType::shift }, // Later declarations bind tighter
+            { "Assign", "comma", ActionType::reduce },
+            { "Range", "plus", ActionType::shift },
+            { "Add", "colon", ActionType::reduce },
+            { "Neg", "star", ActionType::reduce }, // -1*2 is (-1)*2 by %prec Symbol.star
+            { "Neg", "plus", ActionType::reduce },
+            { "Neg", "minus", ActionType::reduce }
+        };
+
+        std::string_view action_name(const ActionType type)
+        {
+            switch (type)
+            {
+                case ActionType::shift: return "shift";
+                case ActionType::reduce: return "reduce";
+                case ActionType::accept: return "accept";
+                default: return "error";
+            }
+        }
+
+        bool check_expectation(const Grammar& grammar, const std::vector<TableRow>& table, const Expectation& expected)
+        {
+            size_t rule_index = 0; // Reduce actions number the rules of all non-terminals in order
+            for (const auto& rules : grammar.rules)
+            {
+                const auto iter = std::find_if(rules.begin(), rules.end(),
+                    [&](const Rule& rule) { return rule.type_name == expected.alternative; });
+                if (iter != rules.end())
+                {
+                    rule_index += size_t(iter - rules.begin());
+                    break;
+                }
+                rule_index += rules.size();
+            }
+            const auto type = std::find_if(grammar.token_types.begin(), grammar.token_types.end(),
+                [&](const TokenType& token) { return token.enumerator == expected.lookahead; });
+            const size_t token = size_t(type - grammar.token_types.begin());
+            bool passed = true, found = false;
+            for (const auto [i, row] : enumerate(table))
+            {
+                if (!contains(row.actions, Action{ ActionType::reduce, rule_index })) continue;
+                found = true;
+                const ActionType action = row.actions[token].type;
+                // A %nonassoc error must also be kept from default reductions
+                if (action == expected.action &&
+                    (action != ActionType::error || contains(row.explicit_errors, token))) continue;
+                fmt::print("State {} reducing {} on {} should {}, but does {}\n", i, expected.alternative,
+                    expected.lookahead, action_name(expected.action), action_name(action));
+                passed = false;
+            }
+            if (!found) fmt::print("No state reduces {}\n", expected.alternative);
+            return passed && found;
+        }
+    }
+
+    bool run_self_test()
+    {
+        bool passed = true;
+        try
+        {
+            const Grammar grammar = process_input(precedence_grammar);
+            // Both engines must agree, and the item sets built on several threads must not differ
+            for (const size_t thread_count : { 1, 3 })
+            {
+                const std::vector<TableRow> table = generate_verified_table(grammar, nullptr, thread_count);
+                for (const Expectation& expected : expectations)
+                    passed = check_expectation(grammar, table, expected) && passed;
+            }
+        }
+        catch (const std::runtime_error& e)
+        {
+            fmt::print("{}\n", e.what());
+            passed = false;
+        }
+        fmt::print(passed ? "Self test passed\n" : "Self test failed\n");
+        return passed;
+    }
+}
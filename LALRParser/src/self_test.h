@@ -0,0 +1,9 @@
+#pragma once
+
+namespace cls::lalr
+{
+    // Builds the table of a small expression grammar with both lookahead engines and checks the
+    // entries resolved by each precedence declaration, prints the entries that differ from the
+    // expected ones and returns whether all of them matched
+    bool run_self_test();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cls::utils
+{
+    using FileId = uint32_t;
+
+    // Maps source files into memory read-only and hands out views of their contents,
+    // no copy of the file is made and the OS pages the contents in on demand,
+    // so files larger than the physical memory can be processed as well.
+    // The views stay valid as long as the manager is alive.
+    class SourceManager final
+    {
+    private:
+        class MappedFile;
+        std::vector<std::unique_ptr<MappedFile>> files_;
+    public:
+        SourceManager();
+        SourceManager(const SourceManager&) = delete;
+        SourceManager& operator=(const SourceManager&) = delete;
+        ~SourceManager() noexcept;
+        FileId open(const std::string& path);
+        std::string_view text(FileId id) const;
+        const std::string& path(FileId id) const;
+        size_t file_count() const { return files_.size(); }
+    };
+}
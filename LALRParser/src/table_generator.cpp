@@ -1,9 +1,13 @@
 #include "functions.h"
-#include <unordered_set>
 #include <algorithm>
+#include <deque>
 #include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include "utils.h"
 #include "overload.h"
+#include "thread_pool.h"
 
 namespace cls::lalr
 {
@@ -45,65 +49,119 @@ namespace cls::lalr
             size_t non_terminal = 0;
             size_t rule = 0;
             size_t dot = 0;
-            std::unordered_set<size_t> lookahead;
-            // Check if two items are the same LR(0) item
-            bool lr0_equals(const Item& other) const
+            TokenSet lookahead;
+        };
+
+        // Sorted (non_terminal, rule, dot) triples of the kernel items of an item set, flattened
+        using Kernel = std::vector<size_t>;
+
+        struct KernelHash final
+        {
+            size_t operator()(const Kernel& kernel) const
             {
-                return non_terminal == other.non_terminal &&
-                    rule == other.rule &&
-                    dot == other.dot;
-            }
-            // Insert current item into a item set, lookahead set may be moved away
-            MergeResult merge_into(std::vector<Item>& item_set) &&
-            {
-                const auto iter = std::find_if(item_set.begin(), item_set.end(),
-                    [this](const Item& it) { return lr0_equals(it); });
-                if (iter == item_set.end())
-                {
-                    item_set.emplace_back(Item{ non_terminal, rule, dot,
-                        std::move(lookahead) });
-                    return { item_set.size() - 1, true };
-                }
-                auto& target = iter->lookahead;
-                bool updated = false;
-                for (const size_t token : lookahead)
-                    if (target.insert(token).second)
-                        updated = true;
-                const size_t merged_index(iter - item_set.begin());
-                return { merged_index, updated };
+                size_t hash = kernel.size();
+                for (const size_t value : kernel)
+                    hash ^= std::hash<size_t>{}(value) + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+                return hash;
             }
         };
 
+        // A non-terminal in the closure of another one, and the lookahead its items get there
+        struct ClosureEntry final
+        {
+            size_t non_terminal = 0;
+            TokenSet lookahead;
+        };
+
         struct Transition final
         {
             TermIndex term;
             size_t dest_index = 0;
         };
 
+        // Items after moving the dot over a term, grouped by the term in the order the terms first appear
+        using ItemGroups = std::vector<std::pair<TermIndex, std::vector<Item>>>;
+
+        // Computes F(x) = F'(x) + U{ F(y) | x R y } for all x, the sets hold F'(x) initially,
+        // strongly connected components of the relation are collapsed on the way (DeRemer & Pennello)
+        void digraph(const std::vector<std::vector<size_t>>& relation, std::vector<TokenSet>& sets)
+        {
+            constexpr size_t done = max_size;
+            std::vector<size_t> depth(sets.size(), 0);
+            std::vector<size_t> stack;
+            const auto traverse = [&](const auto& self, const size_t x) -> void
+            {
+                stack.emplace_back(x);
+                const size_t x_depth = stack.size();
+                depth[x] = x_depth;
+                for (const size_t y : relation[x])
+                {
+                    if (depth[y] == 0) self(self, y);
+                    depth[x] = std::min(depth[x], depth[y]);
+                    sets[x].merge(sets[y]);
+                }
+                if (depth[x] != x_depth) return;
+                while (true) // x is the root of a component, every member gets the same set
+                {
+                    const size_t top = stack.back();
+                    stack.pop_back();
+                    depth[top] = done;
+                    if (top == x) break;
+                    sets[top] = sets[x];
+                }
+            };
+            for (size_t x = 0; x < sets.size(); x++)
+                if (depth[x] == 0)
+                    traverse(traverse, x);
+        }
+
         class TableGenerator final
         {
         private:
-            static constexpr size_t epsilon = max_size;
             std::vector<std::vector<Item>> item_sets_;
+            std::vector<std::vector<size_t>> sorted_items_; // Item indices of each item set in LR(0) order
+            std::unordered_map<Kernel, size_t, KernelHash> item_set_of_kernel_;
             std::vector<std::vector<Transition>> transitions_;
             const Grammar& grammar_;
+            LookaheadEngine engine_ = LookaheadEngine::merge;
             std::vector<size_t> rule_total_;
-            std::vector<std::unordered_set<size_t>> first_;
+            std::vector<size_t> rule_precedence_; // By the index of the reduce action
+            size_t epsilon_ = 0; // Extra bit after the tokens, lookahead sets never contain it
+            std::vector<TokenSet> first_;
+            std::vector<std::vector<std::vector<TokenSet>>> first_after_; // [nt][rule][dot]: FIRST of the terms after the dot
+            std::vector<std::vector<ClosureEntry>> closure_templates_; // Closure of each non-terminal
+            std::vector<size_t> closure_begin_; // Index of the first closure item of each non-terminal, scratch space
+            size_t thread_count_ = 1;
             std::vector<TableRow> table_;
             std::string error_msg_;
             const Rule& rule_of(const Item& item) const;
+            static std::vector<size_t> sort_items(const std::vector<Item>& item_set);
+            static Kernel kernel_of(const std::vector<Item>& item_set, const std::vector<size_t>& sorted);
             MergeResult merge_set(std::vector<Item>&& item_set);
-            void apply_closure(std::vector<Item>& item_set) const;
+            TableStats stats_;
+            void build_closure_templates();
+            size_t apply_closure(std::vector<Item>& item_set, std::vector<size_t>& closure_begin, bool lookaheads) const;
+            ItemGroups group_successors(const std::vector<Item>& item_set, std::vector<size_t>& group_of_term) const;
             bool is_reduce(const Item& item) const;
+            bool is_nullable(const Term& term) const;
+            size_t successor(size_t item_set, const TermIndex& term) const;
+            Item& find_item(size_t item_set, size_t non_terminal, size_t rule, size_t dot);
             void compute_item_sets();
+            void compute_lr0_item_sets(ThreadPool& pool);
+            void propagate_lookaheads(ThreadPool& pool);
+            void compute_lookaheads();
             void initialize_table();
             std::string term_to_string(const TermIndex& term) const;
             std::string item_set_to_string(const std::vector<Item>& item_set) const;
             void fill_reduce();
+            std::optional<Action> resolve_conflict(const Action& reduce, const Action& shift, size_t token) const;
             void fill_shift();
+            void find_default_reductions();
+            void find_unit_shortcuts();
         public:
-            explicit TableGenerator(const Grammar& grammar);
+            TableGenerator(const Grammar& grammar, LookaheadEngine engine, size_t thread_count);
             std::vector<TableRow> generate_table();
+            const TableStats& stats() const { return stats_; }
         };
 
         const Rule& TableGenerator::rule_of(const Item& item) const
@@ -111,133 +169,481 @@ namespace cls::lalr
             return grammar_.rules[item.non_terminal][item.rule];
         }
 
+        std::vector<size_t> TableGenerator::sort_items(const std::vector<Item>& item_set)
+        {
+            std::vector<size_t> sorted(item_set.size());
+            std::iota(sorted.begin(), sorted.end(), size_t(0));
+            std::sort(sorted.begin(), sorted.end(), [&](const size_t lhs, const size_t rhs)
+            {
+                const Item& l = item_set[lhs];
+                const Item& r = item_set[rhs];
+                return std::tie(l.non_terminal, l.rule, l.dot) < std::tie(r.non_terminal, r.rule, r.dot);
+            });
+            return sorted;
+        }
+
+        Kernel TableGenerator::kernel_of(const std::vector<Item>& item_set, const std::vector<size_t>& sorted)
+        {
+            // Closure items all have the dot at the start, except for the augmented start item
+            Kernel kernel;
+            for (const size_t index : sorted)
+            {
+                const Item& item = item_set[index];
+                if (item.dot == 0 && item.non_terminal != 0) continue;
+                kernel.insert(kernel.end(), { item.non_terminal, item.rule, item.dot });
+            }
+            return kernel;
+        }
+
         MergeResult TableGenerator::merge_set(std::vector<Item>&& item_set)
         {
-            for (const auto [i, target] : enumerate(item_sets_)) // Test each existing item set
+            std::vector<size_t> sorted = sort_items(item_set);
+            const auto [iter, inserted] =
+                item_set_of_kernel_.try_emplace(kernel_of(item_set, sorted), item_sets_.size());
+            if (inserted) // No match, add new item set
             {
-                if (!std::is_permutation(target.begin(), target.end(),
-                    item_set.begin(), item_set.end(),
-                    [](const Item& lhs, const Item& rhs) { return lhs.lr0_equals(rhs); }))
-                    continue; // Not the same LR0 item set
-                bool updated = false;
-                for (Item& item : item_set)
-                {
-                    auto& match = *std::find_if(target.begin(), target.end(),
-                        [&](const Item& it) { return it.lr0_equals(item); });
-                    for (const size_t token : item.lookahead)
-                        if (match.lookahead.insert(token).second) // Insert lookahead tokens
-                            updated = true;
-                }
-                return { i, updated }; // Return insertion index
+                item_sets_.emplace_back(std::move(item_set));
+                sorted_items_.emplace_back(std::move(sorted));
+                return { item_sets_.size() - 1, true };
             }
-            item_sets_.emplace_back(std::move(item_set)); // No match, add new item set
-            return { item_sets_.size() - 1, true };
+            // The same kernel has the same closure, so the items pair up in LR(0) order
+            const size_t index = iter->second;
+            std::vector<Item>& target = item_sets_[index];
+            const std::vector<size_t>& target_sorted = sorted_items_[index];
+            bool updated = false;
+            for (size_t i = 0; i < sorted.size(); i++)
+                if (target[target_sorted[i]].lookahead.merge(item_set[sorted[i]].lookahead)) // Insert lookahead tokens
+                    updated = true;
+            return { index, updated }; // Return insertion index
         }
 
-        void TableGenerator::apply_closure(std::vector<Item>& item_set) const
+        void TableGenerator::build_closure_templates()
         {
-            std::vector<Bool> finished(item_set.size(), false);
-            while (true)
+            const size_t nt_count = grammar_.non_terminals.size();
+            closure_begin_.resize(nt_count, max_size);
+            if (engine_ != LookaheadEngine::merge) return; // LR(0) closures need no lookaheads
+
+            // FIRST of the terms after each position of every rule, the epsilon bit marks a nullable rest
+            first_after_.resize(nt_count);
+            for (const auto [i, rules] : enumerate(grammar_.rules))
+                for (const Rule& rule : rules)
+                {
+                    auto& sets = first_after_[i].emplace_back(rule.terms.size(), TokenSet(epsilon_ + 1));
+                    TokenSet rest(epsilon_ + 1);
+                    rest.insert(epsilon_);
+                    for (size_t dot = rule.terms.size(); dot-- > 0;)
+                    {
+                        sets[dot] = rest;
+                        if (const Terminal* t = std::get_if<Terminal>(&rule.terms[dot]))
+                        {
+                            rest = TokenSet(epsilon_ + 1);
+                            rest.insert(t->index);
+                            continue;
+                        }
+                        const TokenSet& first = first_[std::get<NonTerminal>(rule.terms[dot]).index];
+                        const bool nullable_rest = rest.contains(epsilon_);
+                        if (!first.contains(epsilon_)) rest = TokenSet(epsilon_ + 1);
+                        rest.merge(first);
+                        if (!nullable_rest) rest.erase(epsilon_);
+                    }
+                }
+
+            // The closure of each non-terminal on its own, the epsilon bit in the lookahead of
+            // an entry marks that the lookahead of the expanded non-terminal reaches it
+            closure_templates_.resize(nt_count);
+            std::vector<size_t> slot(nt_count, max_size);
+            for (size_t root = 0; root < nt_count; root++)
             {
-                const auto unfinished_iter = std::find(finished.begin(), finished.end(), false);
-                if (unfinished_iter == finished.end()) break;
-                const size_t index(unfinished_iter - finished.begin());
-                const Item& item = item_set[index];
-                const Rule& rule = rule_of(item);
-                if (rule.terms.size() == item.dot // A -> BCD.
-                    || std::holds_alternative<Terminal>(rule.terms[item.dot])) // A -> B.cD
+                std::vector<ClosureEntry>& entries = closure_templates_[root];
+                entries.push_back({ root, TokenSet(epsilon_ + 1) });
+                entries[0].lookahead.insert(epsilon_);
+                slot[root] = 0;
+                for (size_t i = 0; i < entries.size(); i++)
+                    for (const Rule& rule : grammar_.rules[entries[i].non_terminal])
+                        if (const NonTerminal* nt = rule.terms.empty() ? nullptr : std::get_if<NonTerminal>(&rule.terms[0]);
+                            nt && slot[nt->index] == max_size)
+                        {
+                            slot[nt->index] = entries.size();
+                            entries.push_back({ nt->index, TokenSet(epsilon_ + 1) });
+                        }
+                std::deque<size_t> worklist(entries.size());
+                std::iota(worklist.begin(), worklist.end(), size_t(0));
+                std::vector<Bool> queued(entries.size(), true);
+                TokenSet lookahead(epsilon_ + 1);
+                while (!worklist.empty())
                 {
-                    finished[index] = true;
-                    continue;
+                    const size_t index = worklist.front();
+                    worklist.pop_front();
+                    queued[index] = false;
+                    const size_t nt_index = entries[index].non_terminal;
+                    for (const auto [i, rule] : enumerate(grammar_.rules[nt_index]))
+                    {
+                        const NonTerminal* nt = rule.terms.empty() ? nullptr : std::get_if<NonTerminal>(&rule.terms[0]);
+                        if (!nt) continue;
+                        lookahead = first_after_[nt_index][i][0];
+                        const bool nullable = lookahead.contains(epsilon_);
+                        lookahead.erase(epsilon_);
+                        if (nullable) lookahead.merge(entries[index].lookahead);
+                        const size_t target = slot[nt->index];
+                        if (!entries[target].lookahead.merge(lookahead) || queued[target]) continue;
+                        queued[target] = true;
+                        worklist.emplace_back(target);
+                    }
                 }
-                const size_t nt_index = std::get<NonTerminal>(rule.terms[item.dot]).index; // A -> B.C
-                std::unordered_set<size_t> lookahead;
-                bool all_nullable = true;
-                for (size_t i = item.dot + 1; i < rule.terms.size(); i++)
+                for (const ClosureEntry& entry : entries) slot[entry.non_terminal] = max_size;
+            }
+        }
+
+        // Returns the number of items added
+        size_t TableGenerator::apply_closure(std::vector<Item>& item_set,
+            std::vector<size_t>& closure_begin, const bool lookaheads) const
+        {
+            // All rules of a non-terminal enter the closure together when it first shows up after a dot,
+            // so the item order is the same as expanding the items one by one
+            const size_t kernel_size = item_set.size();
+            std::vector<size_t> expanded;
+            for (size_t i = 0; i < item_set.size(); i++)
+            {
+                const Rule& rule = rule_of(item_set[i]);
+                const size_t dot = item_set[i].dot;
+                if (rule.terms.size() == dot) continue; // A -> BCD.
+                const NonTerminal* nt = std::get_if<NonTerminal>(&rule.terms[dot]); // A -> B.C
+                if (!nt || closure_begin[nt->index] != max_size) continue;
+                closure_begin[nt->index] = item_set.size();
+                expanded.emplace_back(nt->index);
+                for (size_t j = 0; j < grammar_.rules[nt->index].size(); j++)
+                    item_set.emplace_back(Item{ nt->index, j, 0, TokenSet(epsilon_ + 1) });
+            }
+            if (lookaheads)
+            {
+                // Each kernel item A -> a.Bb seeds the closure of B with FIRST(b), plus its own lookahead
+                // if b is nullable, the cached closure of B tells where the seed goes
+                TokenSet seed(epsilon_ + 1);
+                for (size_t i = 0; i < kernel_size; i++)
                 {
-                    all_nullable = false;
-                    const Term& term = rule.terms[i];
-                    if (const Terminal * t = std::get_if<Terminal>(&term))
+                    const Item& item = item_set[i];
+                    const Rule& rule = rule_of(item);
+                    if (rule.terms.size() == item.dot) continue;
+                    const NonTerminal* nt = std::get_if<NonTerminal>(&rule.terms[item.dot]);
+                    if (!nt) continue;
+                    seed = first_after_[item.non_terminal][item.rule][item.dot];
+                    const bool nullable = seed.contains(epsilon_);
+                    seed.erase(epsilon_);
+                    if (nullable) seed.merge(item.lookahead);
+                    for (const ClosureEntry& entry : closure_templates_[nt->index])
                     {
-                        lookahead.insert(t->index);
-                        break;
+                        TokenSet& lookahead = item_set[closure_begin[entry.non_terminal]].lookahead;
+                        lookahead.merge(entry.lookahead);
+                        if (entry.lookahead.contains(epsilon_)) lookahead.merge(seed);
                     }
-                    const NonTerminal& nt = std::get<NonTerminal>(term);
-                    for (const size_t token : first_[nt.index])
-                        if (token != epsilon)
-                            lookahead.insert(token);
-                        else
-                            all_nullable = true;
-                    if (!all_nullable) break;
                 }
-                if (all_nullable)
-                    for (const size_t token : item.lookahead)
-                        lookahead.insert(token);
-                finished[index] = true;
-                for (const auto [i, r] : enumerate(grammar_.rules[nt_index]))
+                // The first rule of every expanded non-terminal collected the lookahead for all of them
+                for (const size_t nt_index : expanded)
+                {
+                    const size_t begin = closure_begin[nt_index];
+                    item_set[begin].lookahead.erase(epsilon_);
+                    for (size_t j = 1; j < grammar_.rules[nt_index].size(); j++)
+                        item_set[begin + j].lookahead = item_set[begin].lookahead;
+                }
+            }
+            for (const size_t nt_index : expanded) closure_begin[nt_index] = max_size;
+            return item_set.size() - kernel_size;
+        }
+
+        ItemGroups TableGenerator::group_successors(const std::vector<Item>& item_set,
+            std::vector<size_t>& group_of_term) const
+        {
+            // group_of_term is scratch space indexed by tokens and then non-terminals, filled with max_size
+            const auto term_slot = [this](const TermIndex& term)
+            {
+                return term.is_terminal ? term.index : grammar_.token_types.size() + term.index;
+            };
+            ItemGroups groups;
+            for (const Item& item : item_set)
+            {
+                if (is_reduce(item)) continue;
+                const TermIndex next_term = get_index(rule_of(item).terms[item.dot]);
+                size_t& group = group_of_term[term_slot(next_term)];
+                if (group == max_size)
                 {
-                    const MergeResult merge_result =
-                        Item{ nt_index, i, 0, lookahead }.merge_into(item_set);
-                    if (merge_result.merged_index == finished.size())
-                        finished.emplace_back(false);
-                    else if (merge_result.updated)
-                        finished[merge_result.merged_index] = false;
+                    group = groups.size();
+                    groups.emplace_back(next_term, std::vector<Item>{});
                 }
+                Item& new_item = groups[group].second.emplace_back(item);
+                new_item.dot++;
             }
+            for (const auto& [next_term, new_set] : groups) group_of_term[term_slot(next_term)] = max_size;
+            return groups;
         }
 
         bool TableGenerator::is_reduce(const Item& item) const { return rule_of(item).terms.size() == item.dot; }
 
+        bool TableGenerator::is_nullable(const Term& term) const
+        {
+            const NonTerminal* nt = std::get_if<NonTerminal>(&term);
+            return nt && first_[nt->index].contains(epsilon_);
+        }
+
+        size_t TableGenerator::successor(const size_t item_set, const TermIndex& term) const
+        {
+            for (const Transition& transition : transitions_[item_set])
+                if (transition.term == term)
+                    return transition.dest_index;
+            return max_size;
+        }
+
+        Item& TableGenerator::find_item(const size_t item_set, const size_t non_terminal,
+            const size_t rule, const size_t dot)
+        {
+            const std::vector<Item>& items = item_sets_[item_set];
+            const std::vector<size_t>& sorted = sorted_items_[item_set];
+            const auto key = std::make_tuple(non_terminal, rule, dot);
+            const auto iter = std::lower_bound(sorted.begin(), sorted.end(), key,
+                [&](const size_t index, const auto& value)
+                {
+                    const Item& item = items[index];
+                    return std::tie(item.non_terminal, item.rule, item.dot) < value;
+                });
+            return item_sets_[item_set][*iter];
+        }
+
         void TableGenerator::compute_item_sets()
         {
-            auto& first_item_set = item_sets_.emplace_back();
-            Item first_item{ 0, 0, 0,  { grammar_.token_types.size() - 1 } };
+            std::vector<Item> first_item_set;
+            Item first_item{ 0, 0, 0, TokenSet(epsilon_ + 1) };
+            if (engine_ == LookaheadEngine::merge)
+                first_item.lookahead.insert(grammar_.token_types.size() - 1); // End of stream
             first_item_set.emplace_back(std::move(first_item));
-            apply_closure(first_item_set);
+            const bool lookaheads = engine_ == LookaheadEngine::merge; // Otherwise only LR(0) item sets are built
+            stats_.closure_items += apply_closure(first_item_set, closure_begin_, lookaheads);
+            merge_set(std::move(first_item_set));
             transitions_.emplace_back();
-            std::vector<Bool> finished{ false };
-            while (true)
+            // Item sets are queued again only when the lookahead of one of their items grows,
+            // the transitions are only recorded on the first visit as they never change
+            std::deque<size_t> worklist{ 0 };
+            std::vector<Bool> queued{ true };
+            std::vector<Bool> visited{ false };
+            std::vector<size_t> group_of_term(grammar_.token_types.size() + grammar_.non_terminals.size(), max_size);
+            while (!worklist.empty())
             {
-                const auto unfinished_iter = std::find(finished.begin(), finished.end(), false);
-                if (unfinished_iter == finished.end()) break;
-                const size_t index(unfinished_iter - finished.begin());
-                std::vector<Bool> processed(item_sets_[index].size());
-                std::transform(item_sets_[index].begin(), item_sets_[index].end(),
-                    processed.begin(), [this](const Item& item) { return is_reduce(item); });
-                finished[index] = true;
-                while (true)
+                const size_t index = worklist.front();
+                worklist.pop_front();
+                queued[index] = false;
+                const bool first_visit = !visited[index];
+                (first_visit ? stats_.item_set_visits : stats_.item_set_revisits)++;
+                visited[index] = true;
+                for (auto& [next_term, new_set] : group_successors(item_sets_[index], group_of_term))
                 {
-                    const auto iter = std::find(processed.begin(), processed.end(), false);
-                    if (iter == processed.end()) break;
-                    size_t i(iter - processed.begin());
-                    const Item& primary_item = item_sets_[index][i];
-                    const Rule& primary_rule = grammar_.rules[primary_item.non_terminal][primary_item.rule];
-                    if (primary_rule.terms.size() == primary_item.dot) continue; // No more shift
-                    const TermIndex next_term = get_index(primary_rule.terms[primary_item.dot]);
-                    std::vector<Item> new_set;
-                    for (; i < processed.size(); i++)
-                        if (!processed[i])
-                        {
-                            const Item& item = item_sets_[index][i];
-                            const Rule& rule = grammar_.rules[item.non_terminal][item.rule];
-                            if (get_index(rule.terms[item.dot]) != next_term) continue;
-                            Item new_item = item;
-                            new_item.dot++;
-                            std::move(new_item).merge_into(new_set);
-                            processed[i] = true;
-                        }
-                    apply_closure(new_set);
+                    stats_.closure_items += apply_closure(new_set, closure_begin_, lookaheads);
                     const MergeResult merge_result = merge_set(std::move(new_set));
-                    transitions_[index].emplace_back(Transition{ next_term, merge_result.merged_index });
-                    if (merge_result.merged_index == finished.size())
+                    if (first_visit)
+                        transitions_[index].emplace_back(Transition{ next_term, merge_result.merged_index });
+                    if (merge_result.merged_index == queued.size())
                     {
                         transitions_.emplace_back();
-                        finished.emplace_back(false);
+                        queued.emplace_back(false);
+                        visited.emplace_back(false);
+                    }
+                    else if (!merge_result.updated || queued[merge_result.merged_index])
+                        continue;
+                    queued[merge_result.merged_index] = true;
+                    worklist.emplace_back(merge_result.merged_index);
+                }
+            }
+        }
+
+        void TableGenerator::compute_lr0_item_sets(ThreadPool& pool)
+        {
+            std::vector<Item> first_item_set{ Item{ 0, 0, 0, TokenSet(epsilon_ + 1) } };
+            stats_.closure_items += apply_closure(first_item_set, closure_begin_, false);
+            merge_set(std::move(first_item_set));
+            transitions_.emplace_back();
+            struct Successor final
+            {
+                TermIndex term;
+                Kernel kernel;
+                size_t dest_index = max_size;
+                std::vector<Item> item_set; // Closure of a kernel that was not found
+                std::vector<size_t> sorted;
+            };
+            // Breadth first, the item sets of a level are expanded in parallel with the kernel map only
+            // being read, then the new item sets are numbered in order, just as the serial worklist does
+            std::vector<std::vector<size_t>> closure_begin(pool.size(), closure_begin_);
+            std::vector<std::vector<size_t>> group_of_term(pool.size(),
+                std::vector<size_t>(grammar_.token_types.size() + grammar_.non_terminals.size(), max_size));
+            std::vector<size_t> closure_items(pool.size(), 0);
+            std::vector<std::vector<Successor>> successors;
+            for (size_t level_begin = 0; level_begin < item_sets_.size();)
+            {
+                const size_t level_end = item_sets_.size();
+                successors.assign(level_end - level_begin, {});
+                pool.parallel_for(level_end - level_begin, [&](const size_t i, const size_t worker)
+                {
+                    for (auto& [next_term, new_set] : group_successors(item_sets_[level_begin + i], group_of_term[worker]))
+                    {
+                        Successor& successor = successors[i].emplace_back();
+                        successor.term = next_term;
+                        successor.kernel = kernel_of(new_set, sort_items(new_set)); // All the items are kernel items
+                        if (const auto iter = item_set_of_kernel_.find(successor.kernel); iter != item_set_of_kernel_.end())
+                        {
+                            successor.dest_index = iter->second;
+                            continue;
+                        }
+                        closure_items[worker] += apply_closure(new_set, closure_begin[worker], false);
+                        successor.sorted = sort_items(new_set);
+                        successor.item_set = std::move(new_set);
+                    }
+                });
+                for (size_t i = 0; i < successors.size(); i++)
+                    for (Successor& successor : successors[i])
+                    {
+                        if (successor.dest_index == max_size)
+                        {
+                            const auto [iter, inserted] =
+                                item_set_of_kernel_.try_emplace(std::move(successor.kernel), item_sets_.size());
+                            if (inserted)
+                            {
+                                item_sets_.emplace_back(std::move(successor.item_set));
+                                sorted_items_.emplace_back(std::move(successor.sorted));
+                                transitions_.emplace_back();
+                            }
+                            successor.dest_index = iter->second;
+                        }
+                        transitions_[level_begin + i].emplace_back(Transition{ successor.term, successor.dest_index });
                     }
-                    else if (merge_result.updated)
-                        finished[merge_result.merged_index] = false;
+                stats_.item_set_visits += level_end - level_begin;
+                level_begin = level_end;
+            }
+            for (const size_t count : closure_items) stats_.closure_items += count;
+        }
+
+        void TableGenerator::propagate_lookaheads(ThreadPool& pool)
+        {
+            // Lookaheads flow along the transitions of the LR(0) automaton in rounds, all item sets whose
+            // lookaheads grew in the previous round are expanded in parallel, merging into the successors
+            // with atomic ORs. The result is the same fixed point as that of the serial worklist.
+            std::vector<size_t> item_offset(item_sets_.size() + 1, 0);
+            for (size_t i = 0; i < item_sets_.size(); i++)
+                item_offset[i + 1] = item_offset[i] + item_sets_[i].size();
+            ConcurrentTokenSets lookaheads(item_offset.back(), epsilon_ + 1);
+            const auto dirty = std::make_unique<std::atomic<bool>[]>(item_sets_.size());
+
+            std::vector<Item> first_item_set{ Item{ 0, 0, 0, TokenSet(epsilon_ + 1) } };
+            first_item_set[0].lookahead.insert(grammar_.token_types.size() - 1); // End of stream
+            stats_.closure_items += apply_closure(first_item_set, closure_begin_, true);
+            for (size_t i = 0; i < first_item_set.size(); i++)
+                lookaheads.merge(i, first_item_set[i].lookahead);
+            dirty[0] = true;
+
+            std::vector<std::vector<size_t>> closure_begin(pool.size(), closure_begin_);
+            std::vector<std::vector<size_t>> group_of_term(pool.size(),
+                std::vector<size_t>(grammar_.token_types.size() + grammar_.non_terminals.size(), max_size));
+            std::vector<size_t> closure_items(pool.size(), 0);
+            std::vector<size_t> round;
+            while (true)
+            {
+                round.clear();
+                for (size_t i = 0; i < item_sets_.size(); i++)
+                    if (dirty[i].exchange(false))
+                        round.emplace_back(i);
+                if (round.empty()) break;
+                stats_.item_set_revisits += round.size();
+                pool.parallel_for(round.size(), [&](const size_t i, const size_t worker)
+                {
+                    const size_t index = round[i];
+                    std::vector<Item> item_set = item_sets_[index];
+                    for (size_t j = 0; j < item_set.size(); j++)
+                        lookaheads.load(item_offset[index] + j, item_set[j].lookahead);
+                    // The groups come in the same order as the transitions were recorded
+                    for (auto&& [j, group] : enumerate(group_successors(item_set, group_of_term[worker])))
+                    {
+                        std::vector<Item>& new_set = group.second;
+                        closure_items[worker] += apply_closure(new_set, closure_begin[worker], true);
+                        const std::vector<size_t> sorted = sort_items(new_set);
+                        const size_t dest = transitions_[index][j].dest_index;
+                        const std::vector<size_t>& dest_sorted = sorted_items_[dest];
+                        bool updated = false;
+                        for (size_t k = 0; k < sorted.size(); k++)
+                            if (lookaheads.merge(item_offset[dest] + dest_sorted[k], new_set[sorted[k]].lookahead))
+                                updated = true;
+                        if (updated) dirty[dest] = true;
+                    }
+                });
+            }
+            for (const size_t count : closure_items) stats_.closure_items += count;
+            for (size_t i = 0; i < item_sets_.size(); i++)
+                for (size_t j = 0; j < item_sets_[i].size(); j++)
+                    lookaheads.load(item_offset[i] + j, item_sets_[i][j].lookahead);
+        }
+
+        void TableGenerator::compute_lookaheads()
+        {
+            // Non-terminal transitions (p, A), the augmented start symbol gets a virtual one
+            // from the first item set, which is followed by the end of stream
+            struct NonTerminalTransition final
+            {
+                size_t item_set = 0;
+                size_t non_terminal = 0;
+                size_t dest_index = max_size;
+            };
+            const size_t nt_count = grammar_.non_terminals.size();
+            std::vector<NonTerminalTransition> nt_transitions{ {} };
+            std::vector<size_t> nt_transition_index(item_sets_.size() * nt_count, max_size);
+            nt_transition_index[0] = 0;
+            for (const auto [i, transitions] : enumerate(std::as_const(transitions_)))
+                for (const Transition& transition : transitions)
+                {
+                    if (transition.term.is_terminal) continue;
+                    nt_transition_index[i * nt_count + transition.term.index] = nt_transitions.size();
+                    nt_transitions.push_back({ i, transition.term.index, transition.dest_index });
                 }
+
+            // Read(p, A): terminals shifted right after the transition, possibly after nullable non-terminals
+            std::vector<TokenSet> follow(nt_transitions.size(), TokenSet(epsilon_ + 1));
+            follow[0].insert(grammar_.token_types.size() - 1);
+            std::vector<std::vector<size_t>> reads(nt_transitions.size());
+            for (size_t i = 1; i < nt_transitions.size(); i++)
+            {
+                const size_t dest = nt_transitions[i].dest_index;
+                for (const Transition& transition : transitions_[dest])
+                    if (transition.term.is_terminal) // Direct read
+                        follow[i].insert(transition.term.index);
+                    else if (first_[transition.term.index].contains(epsilon_)) // (p, A) reads (r, C)
+                        reads[i].emplace_back(nt_transition_index[dest * nt_count + transition.term.index]);
             }
+            digraph(reads, follow);
+
+            // Follow(p, A) also contains Follow(p', B) for B -> b A c, p' -b-> p and c nullable
+            std::vector<std::vector<size_t>> includes(nt_transitions.size());
+            for (const auto [i, transition] : enumerate(std::as_const(nt_transitions)))
+                for (const Rule& rule : grammar_.rules[transition.non_terminal])
+                {
+                    const auto& terms = rule.terms;
+                    size_t nullable_from = terms.size(); // Start of the longest nullable suffix
+                    while (nullable_from > 0 && is_nullable(terms[nullable_from - 1])) nullable_from--;
+                    size_t item_set = transition.item_set;
+                    for (size_t j = 0; j < terms.size(); j++)
+                    {
+                        if (const NonTerminal* nt = std::get_if<NonTerminal>(&terms[j]); nt && j + 1 >= nullable_from)
+                            includes[nt_transition_index[item_set * nt_count + nt->index]].emplace_back(i);
+                        item_set = successor(item_set, get_index(terms[j]));
+                    }
+                }
+            digraph(includes, follow);
+
+            // Every item A -> a.b in an item set q with p -a-> q takes Follow(p, A) as lookahead,
+            // this includes the reduce items the table is filled from
+            for (const auto [i, transition] : enumerate(std::as_const(nt_transitions)))
+                for (const auto [j, rule] : enumerate(grammar_.rules[transition.non_terminal]))
+                {
+                    size_t item_set = transition.item_set;
+                    for (size_t dot = 0;; dot++)
+                    {
+                        find_item(item_set, transition.non_terminal, j, dot).lookahead.merge(follow[i]);
+                        if (dot == rule.terms.size()) break;
+                        item_set = successor(item_set, get_index(rule.terms[dot]));
+                    }
+                }
         }
 
         void TableGenerator::initialize_table()
@@ -310,6 +716,23 @@ namespace cls::lalr
                 }
         }
 
+        // Resolves a shift-reduce conflict by the precedences of the rule and the token as yacc does,
+        // the result is an error for %nonassoc tokens, nothing if either precedence is missing
+        std::optional<Action> TableGenerator::resolve_conflict(const Action& reduce,
+            const Action& shift, const size_t token) const
+        {
+            const size_t rule_precedence = rule_precedence_[reduce.index];
+            const TokenType& type = grammar_.token_types[token];
+            if (rule_precedence == 0 || type.precedence == 0) return std::nullopt;
+            if (rule_precedence != type.precedence) return rule_precedence > type.precedence ? reduce : shift;
+            switch (type.associativity)
+            {
+                case Associativity::left: return reduce;
+                case Associativity::right: return shift;
+                default: return Action{};
+            }
+        }
+
         void TableGenerator::fill_shift()
         {
             for (const auto [i, transitions] : enumerate(std::as_const(transitions_)))
@@ -323,6 +746,13 @@ namespace cls::lalr
                         const Action new_action{ ActionType::shift, transition.dest_index };
                         Action& action = table_[i].actions[token];
                         if (new_action == action) continue;
+                        if (action.type == ActionType::reduce)
+                            if (const std::optional<Action> resolved = resolve_conflict(action, new_action, token))
+                            {
+                                action = *resolved;
+                                if (action.type == ActionType::error) table_[i].explicit_errors.emplace_back(token);
+                                continue;
+                            }
                         if (action.type != ActionType::error) // S-R conflict
                             error_msg_ += fmt::format("Shift-reduce conflict in item set "
                                 "I{}:\n{}when parsing token {}, conflicting actions are "
@@ -334,25 +764,121 @@ namespace cls::lalr
                 }
         }
 
-        TableGenerator::TableGenerator(const Grammar& grammar) :
-            grammar_(grammar)
+        void TableGenerator::find_default_reductions()
+        {
+            for (TableRow& row : table_)
+            {
+                const Action* only = nullptr;
+                bool consistent = true;
+                for (const Action& action : row.actions)
+                {
+                    if (action.type == ActionType::error) continue;
+                    if (!only) only = &action;
+                    else if (action != *only)
+                    {
+                        consistent = false;
+                        break;
+                    }
+                }
+                if (consistent && only && only->type == ActionType::reduce && row.explicit_errors.empty())
+                    row.default_reduce = only->index;
+            }
+        }
+
+        void TableGenerator::find_unit_shortcuts()
+        {
+            // A state whose only action is reducing a unit rule A: B(b); is entered by the go-to on B
+            // and left by the go-to on A from the same state below, so that go-to can be taken at once
+            std::vector<size_t> unit_result(table_.size(), max_size);
+            for (const auto [i, row] : enumerate(std::as_const(table_)))
+            {
+                if (row.default_reduce == TableRow::no_default_reduce) continue;
+                const size_t non_terminal = size_t(std::upper_bound(rule_total_.begin(), rule_total_.end(),
+                    row.default_reduce) - rule_total_.begin()) - 1;
+                const Rule& rule = grammar_.rules[non_terminal][row.default_reduce - rule_total_[non_terminal]];
+                if (non_terminal == 0 || grammar_.lists[non_terminal] || rule.terms.size() != 1) continue;
+                if (const NonTerminal* nt = std::get_if<NonTerminal>(&rule.terms[0]); nt && !nt->is_list)
+                    unit_result[i] = non_terminal;
+            }
+            for (TableRow& row : table_)
+                for (const auto [nt, target] : enumerate(std::as_const(row.go_to)))
+                {
+                    if (target == TableRow::no_goto || unit_result[target] == max_size) continue;
+                    UnitShortcut& shortcut = row.unit_shortcuts.emplace_back(UnitShortcut{ nt, target, {} });
+                    while (unit_result[shortcut.state] != max_size)
+                    {
+                        if (shortcut.rules.size() == grammar_.non_terminals.size())
+                            error("Unit rules of \"{}\" form a cycle", grammar_.non_terminals[nt]);
+                        shortcut.rules.push_back(table_[shortcut.state].default_reduce);
+                        shortcut.state = row.go_to[unit_result[shortcut.state]];
+                    }
+                    stats_.unit_shortcuts++;
+                }
+        }
+
+        TableGenerator::TableGenerator(const Grammar& grammar, const LookaheadEngine engine, const size_t thread_count) :
+            grammar_(grammar), engine_(engine), epsilon_(grammar.token_types.size()), thread_count_(thread_count)
         {
             std::exclusive_scan(grammar_.rules.begin(), grammar_.rules.end(),
                 std::back_inserter(rule_total_), 0,
                 [](const size_t lhs, const auto& rhs) { return lhs + rhs.size(); });
+            for (const auto& rules : grammar_.rules)
+                for (const Rule& rule : rules)
+                    rule_precedence_.emplace_back(rule.precedence);
         }
 
         std::vector<TableRow> TableGenerator::generate_table()
         {
+            using Clock = std::chrono::steady_clock;
+            auto start = Clock::now();
+            const auto lap = [&start](std::chrono::nanoseconds& time)
+            {
+                const auto now = Clock::now();
+                time = now - start;
+                start = now;
+            };
             first_ = compute_first_set(grammar_);
-            compute_item_sets();
+            lap(stats_.first_set_time);
+            build_closure_templates();
+            if (thread_count_ == 1)
+                compute_item_sets();
+            else
+            {
+                ThreadPool pool(thread_count_);
+                compute_lr0_item_sets(pool);
+                if (engine_ == LookaheadEngine::merge) propagate_lookaheads(pool);
+            }
+            if (engine_ == LookaheadEngine::deremer_pennello) compute_lookaheads();
+            lap(stats_.item_set_time);
             initialize_table();
             fill_reduce();
             fill_shift();
+            lap(stats_.fill_time);
             if (!error_msg_.empty()) error("{}", std::move(error_msg_));
+            find_default_reductions();
+            find_unit_shortcuts();
             return std::move(table_);
         }
     }
 
-    std::vector<TableRow> generate_table(const Grammar& grammar) { return TableGenerator(grammar).generate_table(); }
+    std::vector<TableRow> generate_table(const Grammar& grammar, const LookaheadEngine engine,
+        TableStats* stats, const size_t thread_count)
+    {
+        TableGenerator generator(grammar, engine, thread_count);
+        std::vector<TableRow> table = generator.generate_table();
+        if (stats) *stats = generator.stats();
+        return table;
+    }
+
+    std::vector<TableRow> generate_verified_table(const Grammar& grammar, TableStats* stats, const size_t thread_count)
+    {
+        std::vector<TableRow> table = generate_table(grammar, LookaheadEngine::merge, stats, thread_count);
+        const std::vector<TableRow> other = generate_table(grammar, LookaheadEngine::deremer_pennello, nullptr, thread_count);
+        if (table.size() != other.size())
+            error("Lookahead engines disagree on the number of states, {} vs {}", table.size(), other.size());
+        for (const auto [i, row] : enumerate(std::as_const(table)))
+            if (row != other[i])
+                error("Lookahead engines disagree on the table row of state {}", i);
+        return table;
+    }
 }
@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include "utils.h"
+
+namespace cls::utils
+{
+    namespace
+    {
+        uint64_t pack(const uint64_t begin, const uint64_t end) { return begin << 32 | end; }
+        size_t begin_of(const uint64_t bounds) { return size_t(bounds >> 32); }
+        size_t end_of(const uint64_t bounds) { return size_t(bounds & UINT32_MAX); }
+    }
+
+    ThreadPool::ThreadPool(const size_t thread_count) :
+        size_(thread_count == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : thread_count)
+    {
+        ranges_ = std::make_unique<Range[]>(size_);
+        threads_.reserve(size_ - 1);
+        for (size_t i = 1; i < size_; i++)
+            threads_.emplace_back([this, i] { run(i); });
+    }
+
+    ThreadPool::~ThreadPool() noexcept
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        start_.notify_all();
+        for (std::thread& thread : threads_) thread.join();
+    }
+
+    bool ThreadPool::pop(const size_t worker, size_t& index)
+    {
+        std::atomic<uint64_t>& bounds = ranges_[worker].bounds;
+        uint64_t current = bounds.load();
+        while (begin_of(current) < end_of(current))
+            if (bounds.compare_exchange_weak(current, pack(begin_of(current) + 1, end_of(current))))
+            {
+                index = begin_of(current);
+                return true;
+            }
+        return false;
+    }
+
+    bool ThreadPool::steal(const size_t worker)
+    {
+        for (size_t i = 1; i < size_; i++)
+        {
+            std::atomic<uint64_t>& bounds = ranges_[(worker + i) % size_].bounds;
+            uint64_t current = bounds.load();
+            while (begin_of(current) < end_of(current))
+            {
+                const size_t begin = begin_of(current), end = end_of(current);
+                const size_t middle = end - (end - begin + 1) / 2; // Take the back half, at least one index
+                if (!bounds.compare_exchange_weak(current, pack(begin, middle))) continue;
+                ranges_[worker].bounds.store(pack(middle, end));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::work(const size_t worker)
+    {
+        // A worker may leave while another one still holds stolen indices, those are run by their owner
+        size_t index = 0;
+        do
+            while (pop(worker, index))
+                (*task_)(index, worker);
+        while (steal(worker));
+    }
+
+    void ThreadPool::run(const size_t worker)
+    {
+        size_t generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex_);
+                start_.wait(lock, [&] { return stopping_ || generation_ != generation; });
+                if (stopping_) return;
+                generation = generation_;
+            }
+            work(worker);
+            std::lock_guard lock(mutex_);
+            if (--running_ == 0) done_.notify_one();
+        }
+    }
+
+    void ThreadPool::parallel_for(const size_t count, const Task& task)
+    {
+        if (count == 0) return;
+        if (count > UINT32_MAX) error("Too many indices for a parallel loop: {}", count);
+        for (size_t i = 0; i < size_; i++)
+            ranges_[i].bounds.store(pack(count * i / size_, count * (i + 1) / size_));
+        {
+            std::lock_guard lock(mutex_);
+            task_ = &task;
+            running_ = size_ - 1;
+            generation_++;
+        }
+        start_.notify_all();
+        work(0);
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [&] { return running_ == 0; });
+        task_ = nullptr;
+    }
+}
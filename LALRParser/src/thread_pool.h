@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cls::utils
+{
+    // A fixed set of worker threads running parallel loops. Each worker starts with an even
+    // share of the indices and steals half of the remaining indices of another worker when
+    // its own share runs out, the calling thread takes part as worker 0.
+    class ThreadPool final
+    {
+    public:
+        using Task = std::function<void(size_t index, size_t worker)>;
+    private:
+        struct alignas(64) Range final
+        {
+            std::atomic<uint64_t> bounds{ 0 }; // Begin in the higher half, end in the lower half
+        };
+        std::vector<std::thread> threads_;
+        std::unique_ptr<Range[]> ranges_;
+        size_t size_ = 1;
+        std::mutex mutex_;
+        std::condition_variable start_;
+        std::condition_variable done_;
+        const Task* task_ = nullptr;
+        size_t generation_ = 0;
+        size_t running_ = 0;
+        bool stopping_ = false;
+
+        bool pop(size_t worker, size_t& index);
+        bool steal(size_t worker);
+        void work(size_t worker);
+        void run(size_t worker);
+    public:
+        // Uses all hardware threads if the thread count is 0
+        explicit ThreadPool(size_t thread_count);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool() noexcept;
+        size_t size() const { return size_; }
+        // Calls the task for every index in [0, count) and waits for all of them,
+        // the worker index is below size() and may be used to pick per thread scratch space
+        void parallel_for(size_t count, const Task& task);
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+namespace cls::lalr
+{
+    // A dense bit set of token indices with a fixed width, unions are done a word at a time
+    class TokenSet final
+    {
+    private:
+        friend class ConcurrentTokenSets;
+        using Word = uint64_t;
+        static constexpr size_t word_bits = 64;
+        std::vector<Word> words_;
+
+        static size_t count_trailing_zeros(const Word word)
+        {
+#if defined(_MSC_VER)
+            unsigned long index = 0;
+            if (_BitScanForward(&index, uint32_t(word))) return size_t(index);
+            _BitScanForward(&index, uint32_t(word >> 32));
+            return size_t(index) + 32;
+#else
+            return size_t(__builtin_ctzll(word));
+#endif
+        }
+        size_t end_index() const { return words_.size() * word_bits; }
+        size_t find_next(const size_t from) const
+        {
+            size_t word = from / word_bits;
+            if (word >= words_.size()) return end_index();
+            Word bits = words_[word] & (~Word(0) << (from % word_bits));
+            while (bits == 0)
+            {
+                if (++word == words_.size()) return end_index();
+                bits = words_[word];
+            }
+            return word * word_bits + count_trailing_zeros(bits);
+        }
+    public:
+        class Iterator final
+        {
+        private:
+            const TokenSet* set_ = nullptr;
+            size_t index_ = 0;
+        public:
+            Iterator(const TokenSet* set, const size_t index) :set_(set), index_(index) {}
+            size_t operator*() const { return index_; }
+            Iterator& operator++() { index_ = set_->find_next(index_ + 1); return *this; }
+            bool operator==(const Iterator& other) const { return index_ == other.index_; }
+            bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+        };
+
+        TokenSet() = default;
+        explicit TokenSet(const size_t bit_count) :words_((bit_count + word_bits - 1) / word_bits) {}
+        void insert(const size_t index) { words_[index / word_bits] |= Word(1) << (index % word_bits); }
+        void erase(const size_t index) { words_[index / word_bits] &= ~(Word(1) << (index % word_bits)); }
+        bool contains(const size_t index) const { return (words_[index / word_bits] >> (index % word_bits)) & 1; }
+        // Unite with a set of the same width, returns whether any index was added
+        bool merge(const TokenSet& other)
+        {
+            Word added = 0;
+            for (size_t i = 0; i < words_.size(); i++) // Simple enough for the compiler to vectorize
+            {
+                added |= other.words_[i] & ~words_[i];
+                words_[i] |= other.words_[i];
+            }
+            return added != 0;
+        }
+        Iterator begin() const { return { this, find_next(0) }; }
+        Iterator end() const { return { this, end_index() }; }
+    };
+
+    // Token sets of the same width in one block, which several threads may merge into at once
+    class ConcurrentTokenSets final
+    {
+    private:
+        using Word = TokenSet::Word;
+        size_t words_per_set_ = 0;
+        std::unique_ptr<std::atomic<Word>[]> words_;
+    public:
+        ConcurrentTokenSets(const size_t set_count, const size_t bit_count) :
+            words_per_set_((bit_count + TokenSet::word_bits - 1) / TokenSet::word_bits),
+            words_(std::make_unique<std::atomic<Word>[]>(set_count * words_per_set_)) {}
+        // Unite a set with one of the same width, returns whether any index was added
+        bool merge(const size_t set, const TokenSet& other)
+        {
+            std::atomic<Word>* words = &words_[set * words_per_set_];
+            bool added = false;
+            for (size_t i = 0; i < words_per_set_; i++)
+                if (other.words_[i] != 0 && (other.words_[i] & ~words[i].fetch_or(other.words_[i], std::memory_order_relaxed)) != 0)
+                    added = true;
+            return added;
+        }
+        // Another thread may be merging into the set meanwhile, any of its words may or may not be seen
+        void load(const size_t set, TokenSet& result) const
+        {
+            const std::atomic<Word>* words = &words_[set * words_per_set_];
+            for (size_t i = 0; i < words_per_set_; i++)
+                result.words_[i] = words[i].load(std::memory_order_relaxed);
+        }
+    };
+}
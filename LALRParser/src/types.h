@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <string>
 #include <variant>
@@ -9,10 +10,16 @@ namespace cls::lalr
 {
     constexpr size_t max_size = size_t(-1);
 
+    enum class Associativity : uint8_t { none, left, right, nonassoc };
+
     struct TokenType final
     {
         std::string type_name;
         std::optional<std::string> enumerator;
+        std::optional<std::string> literal{}; // Exact spelling, e.g. "=" for Symbol.equal
+        std::optional<std::string> pattern{}; // Simple regular expression, e.g. [0-9]+ for Integer
+        size_t precedence = 0; // From %left, %right or %nonassoc, later declarations bind tighter, 0 if none
+        Associativity associativity = Associativity::none;
     };
 
     struct Terminal final
@@ -26,6 +33,7 @@ namespace cls::lalr
         size_t index = max_size;
         bool use_unique_ptr = false;
         std::string variable_name;
+        bool is_list = false; // Written as X...(name) in a rule of X itself, see ListInfo
     };
 
     using Term = std::variant<Terminal, NonTerminal>;
@@ -34,6 +42,15 @@ namespace cls::lalr
     {
         std::string type_name;
         std::vector<Term> terms;
+        size_t precedence = 0; // Given by %prec, or that of the last terminal having one
+    };
+
+    // A non-terminal X with rules like X: X...(items) Symbol.comma Elem(item); | ; is a list,
+    // its node holds the elements in a vector which grows in place on every reduction
+    struct ListInfo final
+    {
+        std::string variable_name; // Of the vector
+        Term element;
     };
 
     struct Grammar final
@@ -41,6 +58,51 @@ namespace cls::lalr
         std::vector<TokenType> token_types;
         std::vector<std::string> non_terminals;
         std::vector<std::vector<Rule>> rules;
+        std::vector<std::optional<ListInfo>> lists; // For every non-terminal
+    };
+
+    // How the LALR(1) lookaheads are computed, both give the same table
+    enum class LookaheadEngine : uint8_t
+    {
+        merge, // Build LR(1) item sets and merge those with the same LR(0) core until nothing changes
+        deremer_pennello // Build the LR(0) automaton once and compute lookaheads from the relations
+    };
+
+    // How the generated parser encodes the parse table
+    enum class TableFormat : uint8_t
+    {
+        switches, // Nested switch statements for every state and token
+        compressed // Row displaced arrays with default actions, read by a small driver loop
+    };
+
+    // Options of the generated parser
+    struct CodeOptions final
+    {
+        TableFormat format = TableFormat::switches;
+        // Unless set, states reduce without reading the lookahead where they can,
+        // so a syntax error may only be found after a few more reductions
+        bool strict_errors = false;
+        // Pointer members become plain pointers into an arena instead of unique pointers, parse()
+        // returns the arena together with the tree and the whole tree is freed at once with it
+        bool arena_ast = false;
+        // Nodes are stored in one array of the parse tree and refer to their children by 32-bit
+        // indices kept in contiguous ranges, instead of being structs of their own
+        bool flat_ast = false;
+    };
+
+    // How often the worklist visited item sets during table generation, a revisit happens
+    // when the lookahead of an already visited item set grew. When built on several threads,
+    // every item set is visited once for the LR(0) automaton and revisited once per round
+    // of lookahead propagation it takes part in.
+    struct TableStats final
+    {
+        size_t item_set_visits = 0;
+        size_t item_set_revisits = 0;
+        size_t closure_items = 0; // Items added by closures, each is expanded exactly once
+        size_t unit_shortcuts = 0; // Go-tos skipping unit reductions
+        std::chrono::nanoseconds first_set_time{};
+        std::chrono::nanoseconds item_set_time{}; // Including the lookaheads
+        std::chrono::nanoseconds fill_time{};
     };
 
     enum class ActionType : uint8_t { shift, reduce, accept, error };
@@ -57,11 +119,43 @@ namespace cls::lalr
         bool operator!=(const Action& other) const { return !(*this == other); }
     };
 
+    // A go-to leading to a state that only reduces a unit rule like Stmt: BlockStmt(stmt);,
+    // followed through all such states
+    struct UnitShortcut final
+    {
+        size_t non_terminal = 0;
+        size_t state = 0; // The first state doing something else
+        std::vector<size_t> rules; // The unit rules reduced on the way, in order
+        bool operator==(const UnitShortcut& other) const
+        {
+            return non_terminal == other.non_terminal
+                && state == other.state
+                && rules == other.rules;
+        }
+        bool operator!=(const UnitShortcut& other) const { return !(*this == other); }
+    };
+
     struct TableRow final
     {
         static constexpr size_t no_goto = max_size;
+        static constexpr size_t no_default_reduce = max_size;
         std::vector<Action> actions;
         std::vector<size_t> go_to;
+        // Rule reduced on every token that is not an error, the lookahead need not be read then
+        size_t default_reduce = no_default_reduce;
+        // Tokens made errors by %nonassoc, those must not be taken over by a default reduction
+        std::vector<size_t> explicit_errors;
+        // Sorted by the non-terminal, only taken when states may reduce without reading the lookahead
+        std::vector<UnitShortcut> unit_shortcuts;
+        bool operator==(const TableRow& other) const
+        {
+            return actions == other.actions
+                && go_to == other.go_to
+                && default_reduce == other.default_reduce
+                && explicit_errors == other.explicit_errors
+                && unit_shortcuts == other.unit_shortcuts;
+        }
+        bool operator!=(const TableRow& other) const { return !(*this == other); }
     };
 
     struct TermIndex final